@@ -0,0 +1,293 @@
+/**
+ * @file keys.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Keystroke latency benchmark of the editor core (make bench).
+ *
+ * Runs the editor headless on a pipe for input and a counting sink for
+ * output, replaying key scripts for typing, scrolling, search and paste
+ * against generated files from 1 KB up to the size given. A key is fed
+ * once the frame of the key before it went out, so the time from feeding
+ * a key to its frame is what a user waits for. Pass 1024 for a 1 GB file.
+ *
+ * Usage: bench-keys [megabytes]
+ ************************************************************************
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "edit.h"
+
+/* Window size of the headless editor */
+#define BENCH_ROWS 24
+#define BENCH_COLS 80
+/* Room for a script */
+#define BENCH_SCRIPT (1024*1024)
+/* Keys of a script, at most */
+#define BENCH_KEYS 4096
+
+/* Key script, keys are stored back to back */
+struct script {
+	const char *name;
+	char *buf;
+	size_t len;
+	size_t at[BENCH_KEYS+1];
+	int n;
+};
+
+/* Replay state shared with the output sink */
+static struct {
+	int fd;
+	const struct script *sc;
+	int next;
+	int done;
+	double fed;
+	double t[BENCH_KEYS];
+	size_t bytes, frame, frame_max;
+} run;
+
+/* Current time in seconds.
+ */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+/* Fill buffer with code like lines, planting a search word now and then.
+ */
+static void fill(char *buf, size_t len)
+{
+	static const char *const words[] = {
+		"static", "int", "search", "engine", "return", "if", "for",
+		"size_t", "char", "row", "(void)", "{", "}", "=", "0;", "s_e",
+		"search_engine"
+	};
+	size_t i = 0;
+	unsigned int seed = 12345;
+	while(i+1 < len) {
+		int n;
+		seed = seed*1103515245+12345;
+		n = (seed>>16)%12;
+		buf[i++] = '\t';
+		while(n-- > 0 && i+1 < len) {
+			const char *w;
+			size_t k;
+			seed = seed*1103515245+12345;
+			k = (seed>>16)%1024;
+			w = words[k == 0 ? 16 : k%16];
+			for(; *w != '\0' && i+1 < len; w++)
+				buf[i++] = *w;
+			if(i+1 < len) buf[i++] = ' ';
+		}
+		if(i+1 < len) buf[i++] = '\n';
+	}
+	if(i < len) buf[i++] = '\n';
+}
+/* Write generated file of 'len' bytes, returns its path.
+ */
+static char *make_file(size_t len)
+{
+	const char *dir = getenv("TMPDIR");
+	size_t chunk = 16*1024*1024, done = 0;
+	char *path, *buf;
+	int fd;
+	if(dir == NULL) dir = "/tmp";
+	path = malloc(strlen(dir)+32);
+	sprintf(path, "%s/prsed-bench-XXXXXX", dir);
+	fd = mkstemp(path);
+	if(fd < 0) {
+		perror("mkstemp");
+		exit(1);
+	}
+	if(chunk > len) chunk = len;
+	buf = malloc(chunk);
+	fill(buf, chunk);
+	while(done < len) {
+		size_t n = len-done < chunk ? len-done : chunk;
+		if(write(fd, buf, n) != (ssize_t)n) {
+			perror("write");
+			exit(1);
+		}
+		done += n;
+	}
+	free(buf);
+	close(fd);
+	return path;
+}
+/* Add key to script.
+ */
+static void key(struct script *sc, const char *s, size_t len)
+{
+	if(sc->n == BENCH_KEYS || sc->len+len > BENCH_SCRIPT) return;
+	memcpy(&sc->buf[sc->len], s, len);
+	sc->len += len;
+	sc->at[++sc->n] = sc->len;
+}
+/* Add keys of a string, one key per character.
+ */
+static void keys(struct script *sc, const char *s)
+{
+	for(; *s != '\0'; s++)
+		key(sc, s, 1);
+}
+/* Build the key scripts.
+ */
+static void scripts(struct script *sc)
+{
+	static const char *const name[] = {
+		"typing", "scrolling", "search", "paste"
+	};
+	char block[8192];
+	int i, j;
+	for(i = 0; i < 4; i++) {
+		sc[i].name = name[i];
+		sc[i].buf = malloc(BENCH_SCRIPT);
+		sc[i].len = 0;
+		sc[i].at[0] = 0;
+		sc[i].n = 0;
+	}
+	/* typing: code with a new line now and then, a few backspaces */
+	for(i = 0; i < 50; i++) {
+		keys(&sc[0], "\tint value = lookup(row, 42); /* fixme */");
+		key(&sc[0], "\x7f", 1);
+		key(&sc[0], "\x7f", 1);
+		key(&sc[0], "\r", 1);
+	}
+	/* scrolling: pages down, lines down, pages back up */
+	for(i = 0; i < 100; i++)
+		key(&sc[1], "\x1b[6~", 4);
+	for(i = 0; i < 200; i++)
+		key(&sc[1], "\x1b[B", 3);
+	for(i = 0; i < 100; i++)
+		key(&sc[1], "\x1b[5~", 4);
+	/* search: incremental query, stepping through matches */
+	for(i = 0; i < 5; i++) {
+		key(&sc[2], "\x06", 1);
+		keys(&sc[2], "search_engine");
+		for(j = 0; j < 20; j++)
+			key(&sc[2], "\x1b[B", 3);
+		key(&sc[2], "\r", 1);
+	}
+	/* paste: bracketed pastes of a 200 line block */
+	for(i = 0, j = 0; i < 200; i++)
+		j += sprintf(&block[j], "\tpasted(%d);\r", i);
+	for(i = 0; i < 20; i++) {
+		char *s = malloc(j+12);
+		memcpy(s, "\x1b[200~", 6);
+		memcpy(s+6, block, j);
+		memcpy(s+6+j, "\x1b[201~", 6);
+		key(&sc[3], s, j+12);
+		free(s);
+		key(&sc[3], "\x1b[B", 3);
+	}
+}
+/* Output sink, each frame answers the key fed before it and lets the
+ * next key in.
+ */
+static void sink(const char *s, size_t len)
+{
+	double t = now();
+	const struct script *sc = run.sc;
+	run.frame += len;
+	if(run.next > 0) run.t[run.next-1] = t-run.fed;
+	run.bytes += run.frame;
+	if(run.frame > run.frame_max) run.frame_max = run.frame;
+	run.frame = 0;
+	if(run.next == sc->n) {
+		run.done = 1;
+		return;
+	}
+	run.fed = now();
+	if(write(run.fd, &sc->buf[sc->at[run.next]],
+	    sc->at[run.next+1]-sc->at[run.next]) < 0) {
+		perror("write");
+		exit(1);
+	}
+	run.next++;
+}
+/* Sort times.
+ */
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+/* Replay script against file and report per key latency.
+ */
+static void replay(const struct script *sc, const char *path)
+{
+	int n = sc->n;
+	reset_editor();
+	editor_open(path);
+	run.sc = sc;
+	run.next = 0;
+	run.done = 0;
+	run.bytes = 0;
+	run.frame = 0;
+	run.frame_max = 0;
+	editor_refresh_screen();
+	/* the first frame fed the first key, the first key's frame is the
+	 * first one that counts */
+	run.bytes = 0;
+	run.frame_max = 0;
+	while(!run.done) {
+		editor_process_key();
+		editor_schedule_refresh();
+	}
+	qsort(run.t, n, sizeof(double), cmp);
+	printf("  %-10s %5d keys  p50 %9.1f us  p99 %9.1f us  "
+		"max %9.1f us  %6lu B/frame (max %lu)\n", sc->name, n,
+		run.t[n/2]*1e6, run.t[n*99/100]*1e6, run.t[n-1]*1e6,
+		(unsigned long)(run.bytes/n), (unsigned long)run.frame_max);
+}
+/* Keystroke latency benchmark.
+ */
+int main(int argc, char **argv)
+{
+	static const size_t sizes[] = {
+		1024, 1024*1024, 16*1024*1024, 256*1024*1024,
+		(size_t)1024*1024*1024
+	};
+	size_t max = (size_t)(argc > 1 ? atoi(argv[1]) : 256)*1024*1024;
+	struct script sc[4];
+	editor_io io;
+	int fds[2], i, k;
+	if(pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+	run.fd = fds[1];
+	io.in = fds[0];
+	io.out = sink;
+	io.rows = BENCH_ROWS;
+	io.cols = BENCH_COLS;
+	editor_use_io(&io);
+	init_editor();
+	scripts(sc);
+	for(i = 0; i < (int)(sizeof(sizes)/sizeof(sizes[0])); i++) {
+		char *path;
+		if(i > 1 && sizes[i] > max) break;
+		path = make_file(sizes[i]);
+		if(sizes[i] < 1024*1024)
+			printf("keys: %lu KB file, %dx%d\n",
+				(unsigned long)(sizes[i]>>10), BENCH_COLS, BENCH_ROWS);
+		else
+			printf("keys: %lu MB file, %dx%d\n",
+				(unsigned long)(sizes[i]>>20), BENCH_COLS, BENCH_ROWS);
+		for(k = 0; k < 4; k++)
+			replay(&sc[k], path);
+		reset_editor();
+		unlink(path);
+		free(path);
+	}
+	for(k = 0; k < 4; k++)
+		free(sc[k].buf);
+	return 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file lineidx.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Line index throughput benchmark (make bench).
+ *
+ * Usage: bench-lineidx [megabytes]
+ ************************************************************************
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lineidx.h"
+#include "pool.h"
+
+/* Runs of each configuration, best one is reported */
+#define BENCH_RUNS 3
+
+/* Current time in seconds.
+ */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+/* Fill buffer with log like lines of random length.
+ */
+static void fill(char *buf, size_t len)
+{
+	size_t i = 0;
+	unsigned int seed = 12345;
+	while(i < len) {
+		size_t n;
+		seed = seed*1103515245+12345;
+		n = (seed>>16)%120;
+		for(; n > 0 && i < len; n--, i++)
+			buf[i] = 'a'+(i%26);
+		if(i < len && (seed & 0x100)) buf[i++] = '\r';
+		if(i < len) buf[i++] = '\n';
+	}
+}
+/* Time one kernel/thread configuration.
+ */
+static int run(const char *buf, size_t len, int kernel, int threads,
+	const lineidx *ref)
+{
+	double best = 0;
+	int r;
+	for(r = 0; r < BENCH_RUNS; r++) {
+		lineidx idx;
+		double t = now(), dt;
+		lineidx_build_with(&idx, buf, len, 64, kernel, threads);
+		dt = now()-t;
+		if(ref != NULL && (idx.lines != ref->lines ||
+		    idx.crlf != ref->crlf || memcmp(idx.start, ref->start,
+		    sizeof(size_t)*idx.nstart) != 0)) {
+			fprintf(stderr, "%s: index mismatch\n",
+				lineidx_kernel_name(kernel));
+			lineidx_free(&idx);
+			return 1;
+		}
+		lineidx_free(&idx);
+		if(r == 0 || dt < best) best = dt;
+	}
+	printf("  %-7s %2d thread%s %8.2f GB/s\n", lineidx_kernel_name(kernel),
+		threads, threads == 1 ? " " : "s", len/best/1e9);
+	return 0;
+}
+/* Line index benchmark.
+ */
+int main(int argc, char **argv)
+{
+	size_t len = (size_t)(argc > 1 ? atoi(argv[1]) : 256)*1024*1024;
+	int kernel, best, threads = pool_threads(), err = 0;
+	lineidx ref;
+	char *buf = malloc(len);
+	if(buf == NULL) {
+		perror("malloc");
+		return 1;
+	}
+	fill(buf, len);
+	lineidx_build_with(&ref, buf, len, 64, LINEIDX_SCALAR, 1);
+	printf("lineidx: %lu MB, %lu lines\n", (unsigned long)(len>>20),
+		(unsigned long)ref.lines);
+	best = lineidx_best_kernel();
+	for(kernel = LINEIDX_SCALAR; kernel <= best; kernel++) {
+		err |= run(buf, len, kernel, 1, &ref);
+		if(threads > 1) err |= run(buf, len, kernel, threads, &ref);
+	}
+	lineidx_free(&ref);
+	free(buf);
+	return err;
+}
@@ -0,0 +1,163 @@
+/**
+ * @file search.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Substring search throughput benchmark (make bench).
+ *
+ * Counts every match of a pattern over generated text, once over the
+ * whole buffer and once row by row like the editor does, for strstr,
+ * memmem and each search kernel. Pass 1024 for a 1 GB buffer.
+ *
+ * Usage: bench-search [megabytes]
+ ************************************************************************
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "search.h"
+
+/* Runs of each configuration, best one is reported */
+#define BENCH_RUNS 3
+/* Pattern planted into the text */
+#define BENCH_PAT "search_engine"
+
+/* Current time in seconds.
+ */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+/* Fill buffer with code like lines, planting the pattern now and then.
+ */
+static void fill(char *buf, size_t len)
+{
+	static const char *const words[] = {
+		"static", "int", "search", "engine", "return", "if", "for",
+		"size_t", "char", "row", "(void)", "{", "}", "=", "0;", "s_e",
+		"SEARCH_ENGINE", "search_engines", "Search_Engine", "search_engine"
+	};
+	size_t i = 0;
+	unsigned int seed = 12345;
+	while(i+1 < len) {
+		int n;
+		seed = seed*1103515245+12345;
+		n = (seed>>16)%12;
+		if(i+1 < len) buf[i++] = '\t';
+		while(n-- > 0 && i+1 < len) {
+			const char *w;
+			size_t k;
+			seed = seed*1103515245+12345;
+			/* pattern words are rare, everything else is common */
+			k = (seed>>16)%4096;
+			w = words[k < 4 ? 16+k : k%16];
+			for(; *w != '\0' && i+1 < len; w++)
+				buf[i++] = *w;
+			if(i+1 < len) buf[i++] = ' ';
+		}
+		if(i+1 < len) buf[i++] = '\n';
+	}
+	buf[i] = '\0';
+}
+/* Count matches over the whole buffer or row by row.
+ */
+static size_t count(const finder *f, int mode, const char *buf, size_t len,
+	int rows)
+{
+	size_t plen = strlen(BENCH_PAT), n = 0;
+	const char *p = buf, *end = buf+len;
+	if(!rows) {
+		while(p < end) {
+			const char *m;
+			if(mode == 0) m = strstr(p, BENCH_PAT);
+			else if(mode == 1) m = memmem(p, end-p, BENCH_PAT, plen);
+			else m = search_find_from(f, buf, len, p-buf);
+			if(m == NULL) break;
+			n++;
+			p = m+1;
+		}
+		return n;
+	}
+	while(p < end) {
+		const char *nl = memchr(p, '\n', end-p);
+		const char *q = (nl != NULL) ? nl : end;
+		size_t at = 0;
+		for(;;) {
+			const char *m;
+			if(mode == 1) m = memmem(p+at, q-p-at, BENCH_PAT, plen);
+			else m = search_find_from(f, p, q-p, at);
+			if(m == NULL) break;
+			n++;
+			at = m-p+1;
+		}
+		p = q+1;
+	}
+	return n;
+}
+/* Time one configuration, return number of matches.
+ */
+static size_t run(const char *name, const finder *f, int mode,
+	const char *buf, size_t len, int rows)
+{
+	double best = 0;
+	size_t n = 0;
+	int r;
+	for(r = 0; r < BENCH_RUNS; r++) {
+		double t = now(), dt;
+		n = count(f, mode, buf, len, rows);
+		dt = now()-t;
+		if(r == 0 || dt < best) best = dt;
+	}
+	printf("  %-20s %-5s %8.2f GB/s %9lu matches\n", name,
+		rows ? "rows" : "whole", len/best/1e9, (unsigned long)n);
+	return n;
+}
+/* Search benchmark.
+ */
+int main(int argc, char **argv)
+{
+	static const int flags[] = { 0, SEARCH_ICASE, SEARCH_WORD };
+	static const char *const opt[] = { "", "/icase", "/word" };
+	size_t len = (size_t)(argc > 1 ? atoi(argv[1]) : 256)*1024*1024;
+	int kernel, best = search_best_kernel(), i, rows, err = 0;
+	size_t ref;
+	char *buf = malloc(len+1);
+	if(buf == NULL) {
+		perror("malloc");
+		return 1;
+	}
+	fill(buf, len);
+	printf("search: %lu MB, pattern \"%s\"\n", (unsigned long)(len>>20),
+		BENCH_PAT);
+	ref = run("strstr", NULL, 0, buf, len, 0);
+	for(rows = 0; rows < 2; rows++) {
+		err |= run("memmem", NULL, 1, buf, len, rows) != ref;
+		for(i = 0; i < 3; i++) {
+			size_t want = 0;
+			for(kernel = SEARCH_SCALAR; kernel <= best; kernel++) {
+				char name[32];
+				finder f;
+				size_t n;
+				search_compile(&f, BENCH_PAT, strlen(BENCH_PAT),
+					flags[i]);
+				search_set_kernel(&f, kernel);
+				sprintf(name, "%s%s", search_kernel_name(kernel),
+					opt[i]);
+				n = run(name, &f, 2, buf, len, rows);
+				if(i == 0) err |= n != ref;
+				else if(kernel == SEARCH_SCALAR) want = n;
+				else err |= n != want;
+				search_free(&f);
+			}
+		}
+	}
+	if(err) fprintf(stderr, "search: match count mismatch\n");
+	free(buf);
+	return err;
+}
@@ -0,0 +1,907 @@
+/**
+ * @file dfa.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Regular expression search for PRS Edit.
+ *
+ * Patterns are parsed into a small tree that is turned into two Thompson
+ * programs, one reading forward and one reading the text backwards.
+ * Neither program is ever run by backtracking, their sets of threads
+ * become automaton states the first time a scan reaches them and every
+ * transition is remembered, so a scan costs one table lookup per byte
+ * once the states it needs are built. When an automaton outgrows
+ * DFA_MAX_STATES it is flushed and rebuilt as the scan goes.
+ *
+ * A line is matched by running the backward automaton (unanchored) over
+ * it once to learn where matches start, then the forward one (anchored)
+ * from the start of each match it reports for the longest match. Forward
+ * scans remember the states that led to no match so no stretch of the
+ * line is read twice in the same state. Whole word search is compiled in
+ * as assertions on the bytes around a match. Lines without the literal
+ * the pattern starts with are skipped by the substring search.
+ ************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dfa.h"
+#include "search.h"
+
+/* Pattern tree node types */
+enum dfa_node {
+	N_SET,
+	N_CAT,
+	N_ALT,
+	N_STAR,
+	N_PLUS,
+	N_QUEST,
+	N_BOL,
+	N_EOL,
+	N_NWB,
+	N_NWA,
+	N_EMPTY
+};
+/* Program instructions, BEGIN and END hold at the edges of a scan,
+ * NWPREV and NWNEXT when the byte read before or after is no word byte */
+enum dfa_op {
+	I_SET,
+	I_SPLIT,
+	I_JMP,
+	I_BEGIN,
+	I_END,
+	I_NWPREV,
+	I_NWNEXT,
+	I_MATCH
+};
+/* Automaton state flags, PREVWORD and BEGIN tell states apart */
+#define ST_MATCH 1
+#define ST_MATCH_END 2
+#define ST_MATCH_NW 4
+#define ST_PREVWORD 8
+#define ST_BEGIN 16
+/* Closure context, what is known around the scan position */
+#define C_BEGIN 1
+#define C_END 2
+#define C_PREVWORD 4
+#define C_NEXT 8
+#define C_NEXTWORD 16
+
+/* Pattern tree node */
+struct node {
+	int type;
+	int a, b;
+};
+/* Program instruction */
+struct inst {
+	int op;
+	int x, y;
+};
+/* Automaton built lazily over one program */
+struct automaton {
+	struct inst *in;
+	int n;
+	int unanchored;
+	int word;
+	int nstates;
+	int *next;
+	unsigned char *flag;
+	int *off, *cnt;
+	int *pcs;
+	int npcs, pcs_cap;
+	int *hash;
+	int start[3];
+	int *mark;
+	int gen;
+	int *tmp;
+	int flushed;
+	unsigned int flushes;
+};
+/* Compiled regular expression */
+struct dfa {
+	int flags;
+	unsigned char (*set)[32];
+	int nset;
+	struct automaton fwd, rev;
+	finder pre;
+	int has_pre;
+	unsigned char *starts;
+	size_t starts_cap;
+	int *memo, *trail;
+	unsigned int *memo_gen;
+	size_t memo_cap;
+	unsigned int gen;
+};
+/* Parser state */
+struct parser {
+	const unsigned char *p, *end;
+	struct node *node;
+	int n, cap;
+	dfa *d;
+	const char *err;
+};
+/* Pattern cache entry */
+struct dfa_entry {
+	char *pat;
+	size_t len;
+	int flags;
+	dfa *d;
+	unsigned long used;
+};
+
+/* Pattern cache */
+static struct dfa_entry dfa_cache[DFA_CACHE];
+static unsigned long dfa_clock;
+
+/* ASCII lower case of byte */
+#define FOLD(c) ((c) >= 'A' && (c) <= 'Z' ? (c)|0x20 : (c))
+/* Byte belongs to a word */
+#define WORDCH(c) ((((c)|0x20) >= 'a' && ((c)|0x20) <= 'z') || \
+	((c) >= '0' && (c) <= '9') || (c) == '_')
+/* Byte set membership */
+#define SET_HAS(s, c) ((s)[(c)>>3] & (1<<((c)&7)))
+
+/* Add new empty byte set, return its index.
+ */
+static int set_new(dfa *d)
+{
+	d->set = realloc(d->set, sizeof(*d->set)*(d->nset+1));
+	memset(d->set[d->nset], 0, sizeof(*d->set));
+	return d->nset++;
+}
+/* Add byte to set, both cases of letters when ignoring case.
+ */
+static void set_add(dfa *d, int s, int c)
+{
+	d->set[s][c>>3] |= 1<<(c&7);
+	if((d->flags & SEARCH_ICASE) && ((c|0x20) >= 'a' && (c|0x20) <= 'z')) {
+		c ^= 0x20;
+		d->set[s][c>>3] |= 1<<(c&7);
+	}
+}
+/* Add bytes of class escape ('d', 'w', 's' or upper case for the rest).
+ */
+static int set_class(dfa *d, int s, int e)
+{
+	int c, neg = (e >= 'A' && e <= 'Z');
+	switch(e|0x20) {
+	case 'd': case 'w': case 's': break;
+	default: return 0;
+	}
+	for(c = 0; c < 256; c++) {
+		int in;
+		switch(e|0x20) {
+		case 'd': in = (c >= '0' && c <= '9'); break;
+		case 'w': in = WORDCH(c); break;
+		default: in = (c == ' ' || (c >= '\t' && c <= '\r')); break;
+		}
+		if(in != neg) d->set[s][c>>3] |= 1<<(c&7);
+	}
+	return 1;
+}
+/* Byte written by an escape.
+ */
+static int esc_byte(int c)
+{
+	switch(c) {
+	case 't': return '\t';
+	case 'n': return '\n';
+	case 'r': return '\r';
+	default: return c;
+	}
+}
+/* Add tree node.
+ */
+static int node_new(struct parser *ps, int type, int a, int b)
+{
+	if(ps->n == ps->cap) {
+		ps->cap = ps->cap ? ps->cap*2 : 32;
+		ps->node = realloc(ps->node, sizeof(struct node)*ps->cap);
+	}
+	ps->node[ps->n].type = type;
+	ps->node[ps->n].a = a;
+	ps->node[ps->n].b = b;
+	return ps->n++;
+}
+static int parse_alt(struct parser *ps);
+/* Parse bracket expression after '['.
+ */
+static int parse_class(struct parser *ps)
+{
+	int s = set_new(ps->d), neg = 0, first = 1, c;
+	if(ps->p < ps->end && *ps->p == '^') {
+		neg = 1;
+		ps->p++;
+	}
+	while(ps->p < ps->end && (*ps->p != ']' || first)) {
+		int lo = *ps->p++, hi;
+		first = 0;
+		if(lo == '\\') {
+			if(ps->p == ps->end) break;
+			lo = *ps->p++;
+			if(set_class(ps->d, s, lo)) continue;
+			lo = esc_byte(lo);
+		}
+		hi = lo;
+		if(ps->p+1 < ps->end && ps->p[0] == '-' && ps->p[1] != ']') {
+			ps->p++;
+			hi = *ps->p++;
+			if(hi == '\\' && ps->p < ps->end) hi = esc_byte(*ps->p++);
+			if(hi < lo) {
+				ps->err = "bad range";
+				return -1;
+			}
+		}
+		for(c = lo; c <= hi; c++)
+			set_add(ps->d, s, c);
+	}
+	if(ps->p == ps->end) {
+		ps->err = "missing ]";
+		return -1;
+	}
+	ps->p++;
+	if(neg)
+		for(c = 0; c < 32; c++)
+			ps->d->set[s][c] ^= 0xff;
+	return node_new(ps, N_SET, s, 0);
+}
+/* Parse single atom.
+ */
+static int parse_atom(struct parser *ps)
+{
+	int c = *ps->p++, s, n;
+	switch(c) {
+	case '(':
+		n = parse_alt(ps);
+		if(n < 0) return -1;
+		if(ps->p == ps->end || *ps->p != ')') {
+			ps->err = "missing )";
+			return -1;
+		}
+		ps->p++;
+		return n;
+	case '[':
+		return parse_class(ps);
+	case '^':
+		return node_new(ps, N_BOL, 0, 0);
+	case '$':
+		return node_new(ps, N_EOL, 0, 0);
+	case '.':
+		s = set_new(ps->d);
+		for(c = 0; c < 256; c++)
+			if(c != '\n') set_add(ps->d, s, c);
+		return node_new(ps, N_SET, s, 0);
+	case '*': case '+': case '?':
+		ps->err = "nothing to repeat";
+		return -1;
+	case '\\':
+		if(ps->p == ps->end) {
+			ps->err = "trailing \\";
+			return -1;
+		}
+		c = *ps->p++;
+		s = set_new(ps->d);
+		if(!set_class(ps->d, s, c)) set_add(ps->d, s, esc_byte(c));
+		return node_new(ps, N_SET, s, 0);
+	default:
+		s = set_new(ps->d);
+		set_add(ps->d, s, c);
+		return node_new(ps, N_SET, s, 0);
+	}
+}
+/* Parse atom with its repeat operators.
+ */
+static int parse_repeat(struct parser *ps)
+{
+	int n = parse_atom(ps);
+	while(n >= 0 && ps->p < ps->end) {
+		switch(*ps->p) {
+		case '*': n = node_new(ps, N_STAR, n, 0); break;
+		case '+': n = node_new(ps, N_PLUS, n, 0); break;
+		case '?': n = node_new(ps, N_QUEST, n, 0); break;
+		default: return n;
+		}
+		ps->p++;
+	}
+	return n;
+}
+/* Parse concatenation.
+ */
+static int parse_cat(struct parser *ps)
+{
+	int n = -1;
+	while(ps->p < ps->end && *ps->p != '|' && *ps->p != ')') {
+		int r = parse_repeat(ps);
+		if(r < 0) return -1;
+		n = (n < 0) ? r : node_new(ps, N_CAT, n, r);
+	}
+	return n < 0 ? node_new(ps, N_EMPTY, 0, 0) : n;
+}
+/* Parse alternation.
+ */
+static int parse_alt(struct parser *ps)
+{
+	int n = parse_cat(ps);
+	while(n >= 0 && ps->p < ps->end && *ps->p == '|') {
+		int r;
+		ps->p++;
+		r = parse_cat(ps);
+		if(r < 0) return -1;
+		n = node_new(ps, N_ALT, n, r);
+	}
+	return n;
+}
+/* Collect literal every match of node starts with, return nonzero when
+ * the whole node was literal and the literal may go on after it.
+ */
+static int literal(const struct parser *ps, int n, char *buf, int *len,
+	int max)
+{
+	const struct node *t = &ps->node[n];
+	const unsigned char *s;
+	int c, k = 0, nb = 0, one = -1;
+	switch(t->type) {
+	case N_CAT:
+		return literal(ps, t->a, buf, len, max) &&
+			literal(ps, t->b, buf, len, max);
+	case N_BOL: case N_EOL: case N_NWB: case N_NWA: case N_EMPTY:
+		return 1;
+	case N_SET:
+		break;
+	default:
+		return 0;
+	}
+	s = ps->d->set[t->a];
+	for(c = 0; c < 256; c++) {
+		if(!SET_HAS(s, c)) continue;
+		if(one < 0 || FOLD(c) != FOLD(one)) k++;
+		if(one < 0) one = c;
+		nb++;
+	}
+	/* a single byte, or a single letter in both cases when folding */
+	if(*len == max) return 0;
+	if((ps->d->flags & SEARCH_ICASE) ? k != 1 : nb != 1) return 0;
+	buf[(*len)++] = (ps->d->flags & SEARCH_ICASE) ? FOLD(one) : one;
+	return 1;
+}
+/* Add instruction to program.
+ */
+static int emit(struct automaton *a, int op, int x, int y)
+{
+	a->in = realloc(a->in, sizeof(struct inst)*(a->n+1));
+	a->in[a->n].op = op;
+	a->in[a->n].x = x;
+	a->in[a->n].y = y;
+	return a->n++;
+}
+/* Generate program for node, reading backwards if 'rev'.
+ */
+static void gen(struct automaton *a, const struct parser *ps, int n, int rev)
+{
+	const struct node *t = &ps->node[n];
+	int l, j;
+	switch(t->type) {
+	case N_SET:
+		emit(a, I_SET, t->a, 0);
+		break;
+	case N_CAT:
+		gen(a, ps, rev ? t->b : t->a, rev);
+		gen(a, ps, rev ? t->a : t->b, rev);
+		break;
+	case N_ALT:
+		l = emit(a, I_SPLIT, a->n+1, 0);
+		gen(a, ps, t->a, rev);
+		j = emit(a, I_JMP, 0, 0);
+		a->in[l].y = a->n;
+		gen(a, ps, t->b, rev);
+		a->in[j].x = a->n;
+		break;
+	case N_STAR:
+		l = emit(a, I_SPLIT, a->n+1, 0);
+		gen(a, ps, t->a, rev);
+		emit(a, I_JMP, l, 0);
+		a->in[l].y = a->n;
+		break;
+	case N_PLUS:
+		l = a->n;
+		gen(a, ps, t->a, rev);
+		emit(a, I_SPLIT, l, a->n+1);
+		break;
+	case N_QUEST:
+		l = emit(a, I_SPLIT, a->n+1, 0);
+		gen(a, ps, t->a, rev);
+		a->in[l].y = a->n;
+		break;
+	case N_BOL:
+		emit(a, rev ? I_END : I_BEGIN, 0, 0);
+		break;
+	case N_EOL:
+		emit(a, rev ? I_BEGIN : I_END, 0, 0);
+		break;
+	case N_NWB:
+		emit(a, rev ? I_NWNEXT : I_NWPREV, 0, 0);
+		break;
+	case N_NWA:
+		emit(a, rev ? I_NWPREV : I_NWNEXT, 0, 0);
+		break;
+	default:
+		break;
+	}
+}
+/* Forget every built state of automaton.
+ */
+static void auto_flush(struct automaton *a)
+{
+	a->nstates = 0;
+	a->npcs = 0;
+	a->start[0] = a->start[1] = a->start[2] = -1;
+	memset(a->hash, 0xff, sizeof(int)*2*DFA_MAX_STATES);
+	a->flushed = 1;
+	a->flushes++;
+}
+/* Allocate automaton tables for its program.
+ */
+static void auto_init(struct automaton *a)
+{
+	int i;
+	a->next = malloc(sizeof(int)*256*DFA_MAX_STATES);
+	a->flag = malloc(DFA_MAX_STATES);
+	a->off = malloc(sizeof(int)*DFA_MAX_STATES);
+	a->cnt = malloc(sizeof(int)*DFA_MAX_STATES);
+	a->hash = malloc(sizeof(int)*2*DFA_MAX_STATES);
+	a->mark = calloc(a->n, sizeof(int));
+	a->tmp = malloc(sizeof(int)*a->n);
+	a->pcs = NULL;
+	a->pcs_cap = 0;
+	a->gen = 0;
+	a->word = 0;
+	for(i = 0; i < a->n; i++)
+		if(a->in[i].op == I_NWPREV) a->word = 1;
+	auto_flush(a);
+}
+/* Free automaton.
+ */
+static void auto_free(struct automaton *a)
+{
+	free(a->in);
+	free(a->next);
+	free(a->flag);
+	free(a->off);
+	free(a->cnt);
+	free(a->hash);
+	free(a->mark);
+	free(a->tmp);
+	free(a->pcs);
+}
+/* Follow empty transitions from 'pc' marking threads of this generation,
+ * context 'cx' tells which assertions hold. Threads on an assertion that
+ * needs the byte after stay marked until it is known.
+ */
+static void closure(struct automaton *a, int pc, int cx)
+{
+	const struct inst *in;
+	int go;
+	if(a->mark[pc] == a->gen) return;
+	a->mark[pc] = a->gen;
+	in = &a->in[pc];
+	switch(in->op) {
+	case I_JMP:
+		closure(a, in->x, cx);
+		return;
+	case I_SPLIT:
+		closure(a, in->x, cx);
+		closure(a, in->y, cx);
+		return;
+	case I_BEGIN: go = cx & C_BEGIN; break;
+	case I_END: go = cx & C_END; break;
+	case I_NWPREV: go = (cx & C_BEGIN) || !(cx & C_PREVWORD); break;
+	case I_NWNEXT:
+		go = (cx & C_END) || ((cx & C_NEXT) && !(cx & C_NEXTWORD));
+		break;
+	default: return;
+	}
+	if(go) closure(a, pc+1, cx);
+}
+/* Context of a state for assertions at its position.
+ */
+static int state_cx(const struct automaton *a, int s)
+{
+	return ((a->flag[s] & ST_BEGIN) ? C_BEGIN : 0) |
+		((a->flag[s] & ST_PREVWORD) ? C_PREVWORD : 0);
+}
+/* Mark the match instruction reached from the waiting threads of the
+ * state under context 'cx', nonzero if it is.
+ */
+static int auto_reaches(struct automaton *a, int s, int cx)
+{
+	const int *pcs = &a->pcs[a->off[s]];
+	int i;
+	a->gen++;
+	for(i = 0; i < a->cnt[s]; i++) {
+		int op = a->in[pcs[i]].op;
+		if(op == I_END || op == I_NWNEXT) closure(a, pcs[i], cx);
+	}
+	return a->mark[a->n-1] == a->gen;
+}
+/* Turn threads marked in this generation into a state with identity
+ * flags 'id', return it.
+ */
+static int auto_state(struct automaton *a, int id)
+{
+	unsigned int h = 2166136261u;
+	int i, k = 0, s, slot, cx;
+	/* canonical thread list, only instructions that wait on input */
+	if(!a->word) id &= ~ST_PREVWORD;
+	for(i = 0; i < a->n; i++) {
+		int op = a->in[i].op;
+		if(a->mark[i] == a->gen && (op == I_SET || op == I_END ||
+		    op == I_NWNEXT || op == I_MATCH)) {
+			a->tmp[k++] = i;
+			h = (h^i)*16777619u;
+		}
+	}
+	h = (h^id)*16777619u;
+	slot = h%(2*DFA_MAX_STATES);
+	for(; (s = a->hash[slot]) >= 0; slot = (slot+1)%(2*DFA_MAX_STATES))
+		if(a->cnt[s] == k &&
+		    (a->flag[s] & (ST_PREVWORD|ST_BEGIN)) == id &&
+		    memcmp(&a->pcs[a->off[s]], a->tmp, sizeof(int)*k) == 0)
+			return s;
+	if(a->nstates == DFA_MAX_STATES) {
+		auto_flush(a);
+		slot = h%(2*DFA_MAX_STATES);
+	}
+	/* new state */
+	s = a->nstates++;
+	if(a->npcs+k > a->pcs_cap) {
+		a->pcs_cap = (a->npcs+k)*2;
+		a->pcs = realloc(a->pcs, sizeof(int)*a->pcs_cap);
+	}
+	memcpy(&a->pcs[a->npcs], a->tmp, sizeof(int)*k);
+	a->off[s] = a->npcs;
+	a->cnt[s] = k;
+	a->npcs += k;
+	a->hash[slot] = s;
+	memset(&a->next[s*256], 0xff, sizeof(int)*256);
+	a->flag[s] = id;
+	for(i = 0; i < k; i++)
+		if(a->in[a->tmp[i]].op == I_MATCH) a->flag[s] |= ST_MATCH;
+	/* does the state match at the scan edge, or before a byte that is
+	 * no word byte */
+	cx = state_cx(a, s);
+	if(auto_reaches(a, s, cx|C_END)) a->flag[s] |= ST_MATCH_END;
+	if(auto_reaches(a, s, cx|C_NEXT)) a->flag[s] |= ST_MATCH_NW;
+	return s;
+}
+/* Start state of automaton, 'kind' is 1 at the edge of the text, 2 after
+ * a word byte and 0 after any other byte.
+ */
+static int auto_start(struct automaton *a, int kind)
+{
+	if(a->start[kind] < 0) {
+		int s;
+		a->gen++;
+		closure(a, 0, kind == 1 ? C_BEGIN : kind == 2 ? C_PREVWORD : 0);
+		s = auto_state(a, kind == 1 ? ST_BEGIN :
+			kind == 2 ? ST_PREVWORD : 0);
+		a->start[kind] = s;
+	}
+	return a->start[kind];
+}
+/* Build transition of state 's' on byte 'c'.
+ */
+static int auto_step(struct automaton *a, const dfa *d, int s, int c)
+{
+	int i, t, k = a->cnt[s], r = 0, w = WORDCH(c);
+	int cx = state_cx(a, s)|C_NEXT|(w ? C_NEXTWORD : 0);
+	const int *pcs = &a->pcs[a->off[s]];
+	/* threads waiting on the byte after go on now it is known; an
+	 * unanchored scan starts a match before every byte, those threads
+	 * only join the state once they took the byte so a match flag never
+	 * stands for an empty match */
+	a->gen++;
+	for(i = 0; i < k; i++)
+		closure(a, pcs[i], cx);
+	if(a->unanchored) closure(a, 0, cx);
+	for(i = 0; i < a->n; i++)
+		if(a->mark[i] == a->gen && a->in[i].op == I_SET)
+			a->tmp[r++] = i;
+	a->gen++;
+	for(i = 0; i < r; i++) {
+		const struct inst *in = &a->in[a->tmp[i]];
+		if(SET_HAS(d->set[in->x], c))
+			closure(a, a->tmp[i]+1, w ? C_PREVWORD : 0);
+	}
+	a->flushed = 0;
+	t = auto_state(a, w ? ST_PREVWORD : 0);
+	if(!a->flushed) a->next[s*256+c] = t;
+	return t;
+}
+/* Compile pattern.
+ */
+dfa *dfa_compile(const char *pat, size_t len, int flags, const char **err)
+{
+	struct parser ps;
+	char buf[128];
+	int root, plen = 0;
+	dfa *d = calloc(1, sizeof(dfa));
+	if(d == NULL) {
+		*err = "out of memory";
+		return NULL;
+	}
+	d->flags = flags;
+	memset(&ps, 0, sizeof(ps));
+	ps.p = (const unsigned char*)pat;
+	ps.end = ps.p+len;
+	ps.d = d;
+	root = parse_alt(&ps);
+	if(root >= 0 && ps.p != ps.end) {
+		ps.err = "unmatched )";
+		root = -1;
+	}
+	if(root < 0) {
+		*err = ps.err;
+		free(ps.node);
+		free(d->set);
+		free(d);
+		return NULL;
+	}
+	/* whole words only, no word byte may touch a match */
+	if(flags & SEARCH_WORD) {
+		root = node_new(&ps, N_CAT, node_new(&ps, N_NWB, 0, 0), root);
+		root = node_new(&ps, N_CAT, root, node_new(&ps, N_NWA, 0, 0));
+	}
+	gen(&d->fwd, &ps, root, 0);
+	emit(&d->fwd, I_MATCH, 0, 0);
+	gen(&d->rev, &ps, root, 1);
+	emit(&d->rev, I_MATCH, 0, 0);
+	d->rev.unanchored = 1;
+	auto_init(&d->fwd);
+	auto_init(&d->rev);
+	literal(&ps, root, buf, &plen, sizeof(buf));
+	if(plen > 0) {
+		search_compile(&d->pre, buf, plen, flags & SEARCH_ICASE);
+		d->has_pre = 1;
+	}
+	free(ps.node);
+	return d;
+}
+/* Copy automaton with its states.
+ */
+static void auto_copy(struct automaton *a, const struct automaton *b)
+{
+	*a = *b;
+	a->in = malloc(sizeof(struct inst)*b->n);
+	memcpy(a->in, b->in, sizeof(struct inst)*b->n);
+	a->next = malloc(sizeof(int)*256*DFA_MAX_STATES);
+	memcpy(a->next, b->next, sizeof(int)*256*b->nstates);
+	a->flag = malloc(DFA_MAX_STATES);
+	memcpy(a->flag, b->flag, b->nstates);
+	a->off = malloc(sizeof(int)*DFA_MAX_STATES);
+	memcpy(a->off, b->off, sizeof(int)*b->nstates);
+	a->cnt = malloc(sizeof(int)*DFA_MAX_STATES);
+	memcpy(a->cnt, b->cnt, sizeof(int)*b->nstates);
+	a->hash = malloc(sizeof(int)*2*DFA_MAX_STATES);
+	memcpy(a->hash, b->hash, sizeof(int)*2*DFA_MAX_STATES);
+	a->pcs = malloc(sizeof(int)*(b->pcs_cap > 0 ? b->pcs_cap : 1));
+	memcpy(a->pcs, b->pcs, sizeof(int)*b->npcs);
+	a->mark = calloc(b->n, sizeof(int));
+	a->tmp = malloc(sizeof(int)*b->n);
+	a->gen = 0;
+}
+/* Copy compiled pattern.
+ */
+dfa *dfa_clone(const dfa *d)
+{
+	dfa *c = malloc(sizeof(dfa));
+	*c = *d;
+	c->set = malloc(sizeof(*d->set)*d->nset);
+	memcpy(c->set, d->set, sizeof(*d->set)*d->nset);
+	auto_copy(&c->fwd, &d->fwd);
+	auto_copy(&c->rev, &d->rev);
+	if(d->has_pre) search_compile(&c->pre, (const char*)d->pre.pat,
+		d->pre.len, d->pre.flags);
+	c->starts = NULL;
+	c->starts_cap = 0;
+	c->memo = c->trail = NULL;
+	c->memo_gen = NULL;
+	c->memo_cap = 0;
+	return c;
+}
+/* Keep automata that got further.
+ */
+void dfa_absorb(dfa *d, dfa *from)
+{
+	struct automaton t;
+	if(from->fwd.nstates > d->fwd.nstates) {
+		t = d->fwd;
+		d->fwd = from->fwd;
+		from->fwd = t;
+	}
+	if(from->rev.nstates > d->rev.nstates) {
+		t = d->rev;
+		d->rev = from->rev;
+		from->rev = t;
+	}
+	dfa_free(from);
+}
+/* Literal prefilter of pattern.
+ */
+const finder *dfa_prefilter(const dfa *d)
+{
+	return d->has_pre ? &d->pre : NULL;
+}
+/* State matches at its position, 'c' is the byte read next or -1 at the
+ * edge of the text.
+ */
+static int at_match(const struct automaton *a, int st, int c)
+{
+	int f = a->flag[st];
+	if(f & ST_MATCH) return 1;
+	if(c < 0) return (f & ST_MATCH_END) != 0;
+	return (f & ST_MATCH_NW) && !WORDCH(c);
+}
+/* Forget every remembered dead end.
+ */
+static void memo_forget(dfa *d)
+{
+	if(++d->gen == 0) {
+		memset(d->memo_gen, 0, sizeof(unsigned int)*d->memo_cap);
+		d->gen = 1;
+	}
+}
+/* Longest non-empty match from 'p' with the forward automaton, -1 if
+ * none. A scan stops where an earlier scan of the line was in the same
+ * state without matching afterwards, the rest of the line would read
+ * the same, so every offset is scanned in a bounded number of states.
+ */
+static long longest(dfa *d, const unsigned char *s, size_t len, size_t p)
+{
+	struct automaton *a = &d->fwd;
+	unsigned int flushes = a->flushes;
+	int st = auto_start(a, p == 0 ? 1 : WORDCH(s[p-1]) ? 2 : 0);
+	long best = -1;
+	size_t i, from = p+1, stop = p;
+	if(a->flushes != flushes) memo_forget(d);
+	for(i = p; i < len; i++) {
+		int t = a->next[st*256+s[i]];
+		if(t < 0) {
+			/* state numbers only hold until the automaton is flushed */
+			flushes = a->flushes;
+			t = auto_step(a, d, st, s[i]);
+			if(a->flushes != flushes) {
+				memo_forget(d);
+				from = i+1;
+			}
+		}
+		st = t;
+		stop = i+1;
+		d->trail[i+1] = st;
+		if(a->cnt[st] == 0) break;
+		if(d->memo_gen[i+1] == d->gen && d->memo[i+1] == st) break;
+		if(at_match(a, st, i+1 < len ? s[i+1] : -1)) best = i+1;
+	}
+	/* states past the last match lead nowhere */
+	if(best >= (long)from) from = best+1;
+	for(i = from; i <= stop; i++) {
+		d->memo[i] = d->trail[i];
+		d->memo_gen[i] = d->gen;
+	}
+	return best;
+}
+/* Mark every offset of the line a non-empty match starts at, reading
+ * backwards.
+ */
+static void starts(dfa *d, const unsigned char *s, size_t len)
+{
+	struct automaton *a = &d->rev;
+	int st = auto_start(a, 1);
+	size_t p;
+	d->starts[len] = 0;
+	for(p = len; p > 0; p--) {
+		int t = a->next[st*256+s[p-1]];
+		st = (t >= 0) ? t : auto_step(a, d, st, s[p-1]);
+		d->starts[p-1] = at_match(a, st, p > 1 ? s[p-2] : -1);
+	}
+}
+/* Make room for scanning a line of 'len' bytes.
+ */
+static void dfa_reserve(dfa *d, size_t len)
+{
+	if(len+1 > d->starts_cap) {
+		d->starts_cap = len+1;
+		d->starts = realloc(d->starts, d->starts_cap);
+	}
+	if(len+1 > d->memo_cap) {
+		size_t cap = len+1;
+		d->memo = realloc(d->memo, sizeof(int)*cap);
+		d->trail = realloc(d->trail, sizeof(int)*cap);
+		d->memo_gen = realloc(d->memo_gen, sizeof(unsigned int)*cap);
+		memset(d->memo_gen+d->memo_cap, 0,
+			sizeof(unsigned int)*(cap-d->memo_cap));
+		d->memo_cap = cap;
+	}
+}
+/* Call back for every match in line. The backward automaton marks where
+ * matches start, the forward one only runs from the start of each match
+ * it reports.
+ */
+void dfa_find_all(dfa *d, const char *text, size_t len,
+	void (*fn)(void *, size_t, size_t), void *arg)
+{
+	const unsigned char *s = (const unsigned char*)text;
+	size_t p = 0;
+	if(d->has_pre && search_find(&d->pre, text, len) == NULL) return;
+	dfa_reserve(d, len);
+	memo_forget(d);
+	starts(d, s, len);
+	while(p < len) {
+		long end;
+		if(!d->starts[p]) {
+			p++;
+			continue;
+		}
+		end = longest(d, s, len, p);
+		if(end > (long)p) {
+			fn(arg, p, end-p);
+			p = end;
+		} else {
+			p++;
+		}
+	}
+}
+/* Free compiled pattern.
+ */
+void dfa_free(dfa *d)
+{
+	if(d == NULL) return;
+	auto_free(&d->fwd);
+	auto_free(&d->rev);
+	if(d->has_pre) search_free(&d->pre);
+	free(d->set);
+	free(d->starts);
+	free(d->memo);
+	free(d->trail);
+	free(d->memo_gen);
+	free(d);
+}
+/* Get compiled pattern from cache.
+ */
+dfa *dfa_cache_get(const char *pat, size_t len, int flags, const char **err)
+{
+	struct dfa_entry *old = &dfa_cache[0];
+	int i;
+	dfa_clock++;
+	for(i = 0; i < DFA_CACHE; i++) {
+		struct dfa_entry *c = &dfa_cache[i];
+		if(c->d != NULL && c->len == len && c->flags == flags &&
+		    memcmp(c->pat, pat, len) == 0) {
+			c->used = dfa_clock;
+			return c->d;
+		}
+		if(c->used < old->used) old = c;
+	}
+	/* least recently used entry makes room */
+	dfa_free(old->d);
+	free(old->pat);
+	memset(old, 0, sizeof(struct dfa_entry));
+	old->d = dfa_compile(pat, len, flags, err);
+	if(old->d == NULL) return NULL;
+	old->pat = malloc(len+1);
+	memcpy(old->pat, pat, len);
+	old->len = len;
+	old->flags = flags;
+	old->used = dfa_clock;
+	return old->d;
+}
+/* Free cached patterns.
+ */
+void dfa_cache_clear(void)
+{
+	int i;
+	for(i = 0; i < DFA_CACHE; i++) {
+		dfa_free(dfa_cache[i].d);
+		free(dfa_cache[i].pat);
+		memset(&dfa_cache[i], 0, sizeof(struct dfa_entry));
+	}
+}
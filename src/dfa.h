@@ -0,0 +1,44 @@
+/**
+ * @file dfa.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Regular expression search with lazily built automata.
+ ********************************************************************
+ */
+
+#ifndef DFA_H
+#define DFA_H
+
+#include <stddef.h>
+
+#include "search.h"
+
+/* Automaton states built per direction before they are all flushed */
+#define DFA_MAX_STATES 1024
+/* Compiled patterns kept by the pattern cache */
+#define DFA_CACHE 16
+
+/* Compiled regular expression */
+typedef struct dfa dfa;
+
+/* Compile pattern honouring SEARCH_ICASE and SEARCH_WORD, returns NULL
+ * with a message in 'err' when the pattern is broken. */
+dfa *dfa_compile(const char *pat, size_t len, int flags, const char **err);
+/* Copy compiled pattern with the states built so far. */
+dfa *dfa_clone(const dfa *d);
+/* Keep whichever automata of the two got further in 'd', free 'from'. */
+void dfa_absorb(dfa *d, dfa *from);
+/* Literal every match starts with, NULL if the pattern has none. */
+const finder *dfa_prefilter(const dfa *d);
+/* Call 'fn' with offset and length of each leftmost longest non-empty
+ * match in one line of text. */
+void dfa_find_all(dfa *d, const char *s, size_t len,
+	void (*fn)(void *, size_t, size_t), void *arg);
+/* Free compiled pattern. */
+void dfa_free(dfa *d);
+/* Get compiled pattern from the cache, compiling it when missing. */
+dfa *dfa_cache_get(const char *pat, size_t len, int flags, const char **err);
+/* Free every cached pattern. */
+void dfa_cache_clear(void);
+
+#endif
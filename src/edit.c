@@ -19,13 +19,32 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <termios.h>
 #include <unistd.h>
 
 #include "edit.h"
+#include "rows.h"
+#include "slab.h"
+#include "lineidx.h"
+#include "pool.h"
+#include "search.h"
+#include "dfa.h"
+#include "undo.h"
+#include "journal.h"
+#include "event.h"
+#include "screen.h"
+#include "syntax.h"
+#include "worker.h"
 
 /* Defines to convert integers into strings */
 #define VAR(x) #x
@@ -36,8 +55,34 @@
 #define PRSED_VERSION STR(VERSION_MAJOR) "." STR(VERSION_MINOR)
 /* Editor tab stop */
 #define PRSED_TAB_STOP 4
+/* Matches the search session keeps positions of */
+#define PRSED_SEARCH_MAX (1024*1024)
+/* Leaves scanned by one find-all job */
+#define PRSED_SEARCH_LEAVES 1024
+/* Row pieces written by one writev() call when saving */
+#define PRSED_SAVE_IOV 1024
+/* Bytes a background save writes before letting the editor in */
+#define PRSED_SAVE_STEP (8*1024*1024)
+/* Bytes of undo history kept before the oldest steps are dropped */
+#define PRSED_UNDO_MAX (32*1024*1024)
+/* Milliseconds to wait for more of a bracketed paste */
+#define PRSED_PASTE_WAIT 1000
+/* Frames drawn per second at most while input keeps coming */
+#define PRSED_FPS 60
+/* Seconds a status message stays on screen */
+#define PRSED_STATUS_TIME 5
+/* Milliseconds to wait for the rest of an escape sequence */
+#define PRSED_KEY_WAIT 100
 /* Editor key presses required to quit */
 #define PRSED_QUIT_TIMES 3
+/* Rendered bytes kept for rows before far away rows are dropped */
+#define PRSED_RENDER_LIMIT (8*1024*1024)
+/* Rows looked back for a known lexer state before guessing one */
+#define PRSED_HL_SYNC 256
+/* Rows around the viewport the background worker lexes */
+#define PRSED_HL_AHEAD 4096
+/* Rows lexed by one background job */
+#define PRSED_HL_BATCH 64
 /* Editor foreground color for normal text. */
 #define PRSED_EDITOR_COLOR 33	/* if you want a different color change me */
 #define PRSED_COLOR "\x1b[" STR(PRSED_EDITOR_COLOR) "m"
@@ -54,26 +99,89 @@ enum editor_key {
 	HOME_KEY,
 	END_KEY,
 	PAGE_UP,
-	PAGE_DOWN
-};
-enum editor_highlight {
-	HL_NORMAL = 0,
-	HL_NUMBER,
-	HL_MATCH
+	PAGE_DOWN,
+	PASTE_START
 };
-/* Editor row structure */
-typedef struct erow {
-	int size;
-	int rsize;
-	char *data;
-	char *render;
-	unsigned char *hl;
-} erow;
 /* Editor copy structure */
 typedef struct ecopy {
 	int size;
 	char *data;
 } ecopy;
+/* Match found by the search session, 'text' is the raw row text */
+typedef struct ematch {
+	const char *text;
+	int len;
+	int row;
+	int col;
+	int mlen;
+} ematch;
+/* Find-all job over a run of leaves, keeps its matches 'lo' to 'lo+n' */
+struct search_job {
+	const finder *f;
+	dfa *re;
+	dfa **res;
+	rownode *first;
+	int leaves;
+	int base;
+	int orow, ocol;
+	size_t lo, keep;
+	ematch *m;
+	size_t n, cap;
+	size_t total;
+	size_t before;
+};
+/* Row text handed to the regex matcher by a find-all job */
+struct search_row {
+	struct search_job *j;
+	const char *text;
+	int len;
+	int row;
+};
+/* Incremental search session, stores matches 'lo' to 'lo+n' of 'total'
+ * sorted by row and column */
+typedef struct esearch {
+	char query[128];
+	size_t qlen;
+	int flags;
+	const char *error;
+	int active;
+	int orow, ocol;
+	ematch *m;
+	size_t n, cap;
+	size_t lo;
+	size_t total;
+	size_t before;
+	size_t cur;
+} esearch;
+/* Kinds of save snapshot pieces */
+enum save_kind {
+	SAVE_OWN = 0,	/* text copied into the snapshot */
+	SAVE_MAP,	/* text of loaded rows still in the file mapping */
+	SAVE_LINES	/* mapped lines of lazy leaves, cleaned up when written */
+};
+/* Piece of a save snapshot, 'off' is into the snapshot or the mapping */
+typedef struct epiece {
+	int kind;
+	size_t off, len;
+} epiece;
+/* Background save of a document snapshot, the worker is at byte 'skip'
+ * of piece 'at' and gathers text for writev() in 'iov' */
+typedef struct esave {
+	int active;
+	int fd;
+	char *path, *tmp;
+	epiece *piece;
+	size_t n, cap;
+	char *own;
+	size_t own_len, own_cap;
+	size_t at, skip;
+	size_t done, total, written;
+	unsigned int gen;
+	unsigned int jseq;
+	int pct, shown;
+	struct iovec iov[PRSED_SAVE_IOV];
+	int niov;
+} esave;
 /* Editor config structure */
 struct editor_config {
 	int cx, cy;
@@ -84,12 +192,39 @@ struct editor_config {
 	int screen_cols;
 	int num_rows;
 	int num_copy;
-	erow *row;
+	int copy_cap;
+	slab slab;
+	rowtree rows;
+	erow *open_row;
+	size_t render_bytes;
+	const syntax *syntax;
+	int hl_stale_from;
+	unsigned int hl_gen;
+	unsigned int row_gen;
+	int search_flags;
+	char search_msg[64];
+	esearch search;
+	char *map;
+	size_t map_len;
+	int map_fd;
+	slab copy_slab;
 	ecopy *copy;
+	undo undo;
+	journal journal;
+	esave save;
 	int dirty;
+	unsigned int edit_gen;
+	char *paste;
+	size_t paste_cap;
 	char *filename;
 	char status[80];
 	time_t status_time;
+	int prompting;
+	int fps;
+	double frame_time;
+	int show_stats;
+	editor_io io;
+	int raw;
 	struct termios orig_termios;
 };
 /* Editor config definition */
@@ -98,27 +233,198 @@ struct editor_config e;
  */
 void copy_free(void)
 {
-	void editor_free_copy(ecopy*);
-	int i;
-	for(i = 0; i < e.num_copy; i++)
-		editor_free_copy(&e.copy[i]);
+	slab_free_all(&e.copy_slab);
 	free(e.copy);
 	e.num_copy = 0;
+	e.copy_cap = 0;
 	e.copy = NULL;
 }
+/* Mark document as changed since it was last saved.
+ */
+void editor_dirty(void)
+{
+	e.dirty = 1;
+	e.edit_gen++;
+}
+/* Free document rows and release file mapping.
+ */
+void editor_free_rows(void)
+{
+	/* rows, their text and the tree all live in the document slab */
+	slab_free_all(&e.slab);
+	rows_drop(&e.rows);
+	e.num_rows = 0;
+	e.open_row = NULL;
+	e.render_bytes = 0;
+	e.hl_stale_from = INT_MAX;
+	e.row_gen++;
+	if(e.map != NULL) {
+		munmap(e.map, e.map_len);
+		e.map = NULL;
+		e.map_len = 0;
+	}
+	if(e.map_fd >= 0) {
+		close(e.map_fd);
+		e.map_fd = -1;
+	}
+}
 /* Editor free resources.
  */
 void editor_free(void)
 {
-	void editor_free_row(erow*);
-	void editor_free_copy(ecopy*);
-	int i;
-	for(i = 0; i < e.num_rows; i++)
-		editor_free_row(&e.row[i]);
-	free(e.row);
-	for(i = 0; i < e.num_copy; i++)
-		editor_free_copy(&e.copy[i]);
-	free(e.copy);
+	void editor_save_finish(void);
+	/* the worker may be lexing with the compiled syntax */
+	worker_hold();
+	editor_save_finish();
+	/* a crash recovery journal outlives the editor when it dies */
+	journal_close(&e.journal, 1);
+	editor_free_rows();
+	copy_free();
+	undo_free(&e.undo);
+	free(e.paste);
+	e.paste = NULL;
+	e.paste_cap = 0;
+	syntax_free();
+	worker_release();
+}
+/* Get row at index from the document.
+ */
+erow *editor_row(int at)
+{
+	return rows_get(&e.rows, at);
+}
+/* Get row at index with its render and highlight built.
+ */
+erow *editor_render_row(int at)
+{
+	void editor_update_row(erow *row, int state);
+	int editor_hl_trusted(const erow *row, int at);
+	int editor_syntax_state_in(int at);
+	erow *row = rows_get(&e.rows, at);
+	if(row != NULL && (row->hl == NULL || !editor_hl_trusted(row, at)))
+		editor_update_row(row, editor_syntax_state_in(at));
+	return row;
+}
+/* Rendered bytes held by row.
+ */
+size_t editor_render_size(erow *row)
+{
+	if(row->hl == NULL) return 0;
+	if(row->render != NULL) return 2*row->rsize+1;
+	return row->cap > 0 ? row->cap : 1;
+}
+/* Drop rendered text and highlight of row, rebuilt when next drawn.
+ */
+void editor_drop_render(erow *row)
+{
+	if(row->hl == NULL) return;
+	e.render_bytes -= editor_render_size(row);
+	if(row->render != NULL) {
+		slab_free(&e.slab, row->render, row->rsize+1);
+		slab_free(&e.slab, row->hl, row->rsize+1);
+	} else {
+		slab_free(&e.slab, row->hl, row->cap > 0 ? row->cap : 1);
+	}
+	row->render = NULL;
+	row->hl = NULL;
+	row->rsize = 0;
+}
+/* Drop rendered rows far from the viewport once over the limit.
+ */
+void editor_trim_render(void)
+{
+	rownode *n;
+	int i, at = 0;
+	int lo = e.row_off-e.screen_rows;
+	int hi = e.row_off+2*e.screen_rows;
+	if(e.render_bytes <= PRSED_RENDER_LIMIT) return;
+	for(n = e.rows.first; n != NULL; at += n->n, n = n->next) {
+		if(n->row == NULL || (at >= lo && at+n->n <= hi)) continue;
+		for(i = 0; i < n->n; i++)
+			if(at+i < lo || at+i >= hi)
+				editor_drop_render(&n->row[i]);
+	}
+}
+/* Give row its own copy of text that still lives in the file mapping.
+ */
+void editor_row_own(erow *row)
+{
+	char *data;
+	if(!row->mapped) return;
+	editor_drop_render(row);
+	data = slab_alloc(&e.slab, slab_round(row->size+1));
+	memcpy(data, row->data, row->size);
+	data[row->size] = '\0';
+	row->data = data;
+	row->mapped = 0;
+	row->cap = slab_round(row->size+1);
+	row->gap = row->size;
+}
+/* Move gap of row to 'at' and make room for 'need' more bytes in it.
+ * Highlight of rows without tabs shares the gap layout of the text.
+ */
+void editor_row_gap(erow *row, int at, int need)
+{
+	int hl_gap, glen;
+	editor_row_own(row);
+	row->version++;
+	if(e.open_row != NULL && e.open_row != row) {
+		erow *open = e.open_row;
+		e.open_row = NULL;
+		editor_row_gap(open, open->size, 0);
+	}
+	hl_gap = (row->hl != NULL && row->render == NULL);
+	if(row->cap-row->size < need+1) {
+		int cap = row->cap*2, tail = row->size-row->gap;
+		if(cap < row->size+need+16) cap = row->size+need+16;
+		cap = slab_round(cap);
+		row->data = slab_realloc(&e.slab, row->data, row->cap, cap);
+		memmove(&row->data[cap-tail], &row->data[row->cap-tail], tail);
+		if(hl_gap) {
+			row->hl = slab_realloc(&e.slab, row->hl, row->cap, cap);
+			memmove(&row->hl[cap-tail], &row->hl[row->cap-tail], tail);
+			e.render_bytes += cap-row->cap;
+		}
+		row->cap = cap;
+	}
+	glen = row->cap-row->size;
+	if(at < row->gap) {
+		memmove(&row->data[at+glen], &row->data[at], row->gap-at);
+		if(hl_gap) memmove(&row->hl[at+glen], &row->hl[at], row->gap-at);
+	} else if(at > row->gap) {
+		memmove(&row->data[row->gap], &row->data[row->gap+glen],
+			at-row->gap);
+		if(hl_gap) memmove(&row->hl[row->gap], &row->hl[row->gap+glen],
+			at-row->gap);
+	}
+	row->gap = at;
+	if(at == row->size) {
+		row->data[row->size] = '\0';
+		if(e.open_row == row) e.open_row = NULL;
+	} else {
+		e.open_row = row;
+	}
+}
+/* Close gap of row so that its text is contiguous.
+ */
+void editor_row_flat(erow *row)
+{
+	if(row->gap != row->size)
+		editor_row_gap(row, row->size, 0);
+}
+/* Close gap of the row being edited, before rows move or get walked.
+ */
+void editor_close_row(void)
+{
+	if(e.open_row != NULL)
+		editor_row_flat(e.open_row);
+}
+/* Send output to the terminal, or to the backend in its place.
+ */
+void editor_write(const char *s, size_t len)
+{
+	if(e.io.out != NULL) e.io.out(s, len);
+	else write(STDOUT_FILENO, s, len);
 }
 /* Exit out of the program and report an error.
  */
@@ -127,9 +433,9 @@ void die(const char *msg)
 	void disable_raw(void);
 	disable_raw();
 	editor_free();
-	write(STDOUT_FILENO, "\x1b[m", 3);
-	write(STDOUT_FILENO, "\x1b[2J", 4);
-	write(STDOUT_FILENO, "\x1b[H", 3);
+	editor_write("\x1b[m", 3);
+	editor_write("\x1b[2J", 4);
+	editor_write("\x1b[H", 3);
 	perror(msg);
 	exit(1);
 }
@@ -137,6 +443,9 @@ void die(const char *msg)
  */
 void disable_raw()
 {
+	if(!e.raw) return;
+	e.raw = 0;
+	write(STDOUT_FILENO, "\x1b[?2004l", 8);
 	if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &e.orig_termios) < 0)
 		die("tcsetattr");
 }
@@ -155,9 +464,23 @@ void enable_raw()
 	raw.c_cflag |= (CS8);
 	raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
 	raw.c_cc[VMIN] = 0;
-	raw.c_cc[VTIME] = 1;
+	raw.c_cc[VTIME] = 0;
 	if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) < 0)
 		die("tcsetattr");
+	e.raw = 1;
+	if(event_init(STDIN_FILENO) < 0)
+		die("event_init");
+	/* terminal marks pasted text so it goes in as one edit */
+	write(STDOUT_FILENO, "\x1b[?2004h", 8);
+}
+/* Run editor on backend instead of the terminal.
+ */
+void editor_use_io(const editor_io *io)
+{
+	e.io = *io;
+	screen_output(io->out);
+	if(event_init(io->in) < 0)
+		die("event_init");
 }
 /* Gets the current position of the cursor.
  */
@@ -165,10 +488,12 @@ int get_cursor_pos(int *rows, int *cols)
 {
 	unsigned int i = 0;
 	char buf[32];
+	int c;
 	if(write(STDOUT_FILENO, "\x1b[6n", 4) != 4) return -1;
 	printf("\r\n");
 	while(i < sizeof(buf)-1) {
-		if(read(STDIN_FILENO, &buf[i], 1) != 1) break;
+		if((c = event_getc(PRSED_KEY_WAIT)) < 0) break;
+		buf[i] = c;
 		if(buf[i] == 'R') break;
 		i++;
 	}
@@ -182,6 +507,11 @@ int get_cursor_pos(int *rows, int *cols)
 int get_window_size(int *rows, int *cols)
 {
 	struct winsize ws;
+	if(e.io.out != NULL) {
+		*rows = e.io.rows;
+		*cols = e.io.cols;
+		return 0;
+	}
 	if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0 || ws.ws_col == 0) {
 		if(write(STDOUT_FILENO, "\x1b[999C\x1b[999B", 12) != 12)
 			return -1;
@@ -192,174 +522,537 @@ int get_window_size(int *rows, int *cols)
 		return 0;
 	}
 }
-/* Check if the given character is a seperator.
+/* Lex row from incoming 'state', remember and return its end state.
  */
-int is_seperator(int c)
+int editor_lex_row(erow *row, int state)
 {
-	return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[]{};", c) != NULL;
+	if(row->render != NULL)
+		state = syntax_lex(e.syntax, row->render, row->hl, row->rsize,
+			row->rsize, 0, state);
+	else
+		state = syntax_lex(e.syntax, row->data, row->hl, row->size,
+			row->gap, row->cap-row->size, state);
+	row->hl_end = state;
+	row->hl_gen = e.hl_gen;
+	return state;
 }
-/* Syntax highlighting.
+/* Check if end state of row at index can be relied on.
  */
-void editor_update_syntax(erow *row)
+int editor_hl_trusted(const erow *row, int at)
 {
-	int i, prev_sep = 1;
-	row->hl = realloc(row->hl, row->rsize);
-	for(i = 0; i < row->rsize; i++) {
-		char c = row->render[i];
-		unsigned char prev_hl = (i > 0) ? row->hl[i-1] : HL_NORMAL;
-
-		if((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) ||
-			(c == '.' && prev_hl == HL_NUMBER)) {
-			row->hl[i] = HL_NUMBER;
-			prev_sep = 0;
-			continue;
-		} else {
-			row->hl[i] = HL_NORMAL;
+	return row->hl_end >= 0 &&
+		(at < e.hl_stale_from || row->hl_gen == e.hl_gen);
+}
+/* Forget end states of rows from index 'at' onwards.
+ */
+void editor_hl_invalidate(int at)
+{
+	if(at < e.hl_stale_from) e.hl_stale_from = at;
+	e.hl_gen++;
+}
+/* Get lexer state entering row at index, lexing rows above it as needed.
+ */
+int editor_syntax_state_in(int at)
+{
+	int from, i, state = SYNTAX_NORMAL;
+	if(at <= 0 || !e.syntax->multiline) return state;
+	for(from = at-1; from >= 0 && from >= at-PRSED_HL_SYNC; from--) {
+		erow *row = editor_row(from);
+		if(editor_hl_trusted(row, from)) {
+			state = row->hl_end;
+			break;
 		}
-
-		prev_sep = is_seperator(c);
+	}
+	/* without a known state nearby assume the rows start outside of
+	 * any comment or string */
+	for(i = from+1; i < at; i++)
+		state = editor_lex_row(editor_row(i), state);
+	return state;
+}
+/* Lex row at index after it changed and carry on down while the state
+ * leaving a row differs from what the next row was lexed with.
+ */
+void editor_syntax_changed(int at)
+{
+	int state, first;
+	if(at < 0 || at >= e.num_rows) return;
+	if(!e.syntax->multiline) {
+		editor_lex_row(editor_row(at), SYNTAX_NORMAL);
+		return;
+	}
+	state = editor_syntax_state_in(at);
+	for(first = 1; at < e.num_rows; at++, first = 0) {
+		erow *row = editor_row(at);
+		int old = editor_hl_trusted(row, at) ? row->hl_end : -1;
+		if(!first && old < 0) {
+			/* rows below were never lexed in order, lex them again */
+			editor_hl_invalidate(at);
+			break;
+		}
+		state = editor_lex_row(row, state);
+		if(state == old) break;
+	}
+}
+/* Pick language from file name or from the first line of the file.
+ */
+void editor_select_syntax(void)
+{
+	const char *line = NULL;
+	const syntax *syn;
+	int len = 0;
+	rowiter it;
+	editor_close_row();
+	rows_iter(&it, &e.rows);
+	if(!rows_next(&it, &line, &len)) line = NULL;
+	syn = syntax_find(e.filename, line, len);
+	if(syn != e.syntax) {
+		e.syntax = syn;
+		editor_hl_invalidate(0);
 	}
 }
 /* Convert syntax to color.
  */
 int editor_syntax_to_color(int hl)
 {
-	switch(hl) {
-	case HL_NUMBER: return 31;
-	case HL_MATCH: return 34;
-	default: return PRSED_EDITOR_COLOR;
-	}
+	static const unsigned char colors[HL_MAX] = {
+		PRSED_EDITOR_COLOR, 36, 36, 32, 37, 35, 31, 34
+	};
+	return colors[hl];
 }
-/* Update the rendered string.
+/* Expand tabs of 'len' bytes of text continuing at render column 'idx',
+ * writes to 'dst' unless NULL, counts tabs and returns the end column.
  */
-void editor_update_row(erow *row)
-{
-	int i, idx = 0, tabs = 0;
-	for(i = 0; i < row->size; i++)
-		if(row->data[i] == '\t') tabs++;
-	free(row->render);
-	row->render = malloc(row->size+tabs*(PRSED_TAB_STOP-1)+1);
-	for(i = 0; i < row->size; i++) {
-		if(row->data[i] == '\t') {
-			row->render[idx++] = ' ';
-			while((idx % PRSED_TAB_STOP) != 0)
-				row->render[idx++] = ' ';
+int editor_expand_tabs(const char *s, int len, int idx, char *dst, int *tabs)
+{
+	int i;
+	for(i = 0; i < len; i++) {
+		if(s[i] == '\t') {
+			(*tabs)++;
+			do {
+				if(dst != NULL) dst[idx] = ' ';
+				idx++;
+			} while((idx % PRSED_TAB_STOP) != 0);
 		} else {
-			row->render[idx++] = row->data[i];
+			if(dst != NULL) dst[idx] = s[i];
+			idx++;
 		}
 	}
-	row->render[idx] = '\0';
+	return idx;
+}
+/* Update the rendered string.
+ */
+void editor_update_row(erow *row, int state)
+{
+	const char *tail = &row->data[row->gap+row->cap-row->size];
+	int idx, tabs = 0;
+	idx = editor_expand_tabs(row->data, row->gap, 0, NULL, &tabs);
+	idx = editor_expand_tabs(tail, row->size-row->gap, idx, NULL, &tabs);
+	editor_drop_render(row);
+	row->tabs = tabs;
+	if(tabs == 0) {
+		/* text is its own render, highlight follows its gap */
+		row->rsize = row->size;
+		row->hl = slab_alloc(&e.slab, row->cap > 0 ? row->cap : 1);
+		e.render_bytes += editor_render_size(row);
+		editor_lex_row(row, state);
+		return;
+	}
 	row->rsize = idx;
-	editor_update_syntax(row);
+	row->render = slab_alloc(&e.slab, row->rsize+1);
+	idx = editor_expand_tabs(row->data, row->gap, 0, row->render, &tabs);
+	editor_expand_tabs(tail, row->size-row->gap, idx, row->render, &tabs);
+	row->render[row->rsize] = '\0';
+	row->hl = slab_alloc(&e.slab, row->rsize+1);
+	e.render_bytes += editor_render_size(row);
+	editor_lex_row(row, state);
+}
+/* Background highlighting job, rows are copied in so that they can be
+ * lexed without holding the editor lock.
+ */
+struct hl_job {
+	int from, n, state, guess;
+	int lo, hi;
+	unsigned int row_gen, hl_gen;
+	const syntax *syn;
+	unsigned int *version;
+	int *off, *len, *roff, *rsize, *tabs, *end;
+	int max;
+	char *text, *render;
+	unsigned char *hl;
+	size_t text_cap, render_cap;
+};
+static struct hl_job hl_job;
+/* Check if row at index still needs work from the background worker.
+ */
+int editor_hl_needs(int at, int lo, int hi)
+{
+	erow *row = editor_row(at);
+	int trusted = editor_hl_trusted(row, at);
+	if(e.syntax->multiline && !trusted) return 1;
+	return at >= lo && at < hi && (row->hl == NULL || !trusted);
+}
+/* Pick rows for next job nearest to the viewport and copy them in.
+ */
+int editor_hl_pick(struct hl_job *j)
+{
+	int top = e.row_off, bottom = e.row_off+e.screen_rows;
+	int d, r = -1, s, end, i;
+	size_t len = 0;
+	/* rows kept rendered are the ones editor_trim_render() keeps */
+	j->lo = top-e.screen_rows;
+	j->hi = bottom+e.screen_rows;
+	for(d = 0; d < PRSED_HL_AHEAD && r < 0; d++) {
+		if(bottom+d < e.num_rows && editor_hl_needs(bottom+d, j->lo, j->hi))
+			r = bottom+d;
+		else if(top-1-d >= 0 && editor_hl_needs(top-1-d, j->lo, j->hi))
+			r = top-1-d;
+	}
+	if(r < 0) return 0;
+	for(s = r; s > 0 && s > r-PRSED_HL_SYNC; s--)
+		if(editor_hl_trusted(editor_row(s-1), s-1)) break;
+	j->guess = (s > 0 && !editor_hl_trusted(editor_row(s-1), s-1));
+	j->state = (s > 0 && !j->guess) ? editor_row(s-1)->hl_end :
+		SYNTAX_NORMAL;
+	end = r+PRSED_HL_BATCH;
+	if(end > e.num_rows) end = e.num_rows;
+	j->from = s;
+	j->n = end-s;
+	if(j->n > j->max) {
+		j->max = j->n;
+		j->version = realloc(j->version, sizeof(unsigned int)*j->max);
+		j->off = realloc(j->off, sizeof(int)*j->max);
+		j->len = realloc(j->len, sizeof(int)*j->max);
+		j->roff = realloc(j->roff, sizeof(int)*j->max);
+		j->rsize = realloc(j->rsize, sizeof(int)*j->max);
+		j->tabs = realloc(j->tabs, sizeof(int)*j->max);
+		j->end = realloc(j->end, sizeof(int)*j->max);
+	}
+	for(i = 0; i < j->n; i++)
+		len += editor_row(s+i)->size;
+	if(len > j->text_cap) {
+		j->text_cap = len;
+		j->text = realloc(j->text, len);
+	}
+	for(i = 0, len = 0; i < j->n; i++) {
+		erow *row = editor_row(s+i);
+		int tail = row->size-row->gap;
+		memcpy(&j->text[len], row->data, row->gap);
+		memcpy(&j->text[len+row->gap], &row->data[row->gap+row->cap-row->size],
+			tail);
+		j->version[i] = row->version;
+		j->off[i] = len;
+		j->len[i] = row->size;
+		len += row->size;
+	}
+	j->row_gen = e.row_gen;
+	j->hl_gen = e.hl_gen;
+	j->syn = e.syntax;
+	return 1;
+}
+/* Render and lex copied rows, runs without the editor lock.
+ */
+void editor_hl_lex(struct hl_job *j)
+{
+	size_t rlen = 0;
+	int i, state = j->state;
+	for(i = 0; i < j->n; i++) {
+		j->tabs[i] = 0;
+		j->roff[i] = rlen;
+		j->rsize[i] = editor_expand_tabs(&j->text[j->off[i]], j->len[i], 0,
+			NULL, &j->tabs[i]);
+		rlen += j->rsize[i];
+	}
+	if(rlen > j->render_cap) {
+		j->render_cap = rlen;
+		j->render = realloc(j->render, rlen);
+		j->hl = realloc(j->hl, rlen);
+	}
+	for(i = 0; i < j->n; i++) {
+		int tabs = 0;
+		char *r = &j->render[j->roff[i]];
+		editor_expand_tabs(&j->text[j->off[i]], j->len[i], 0, r, &tabs);
+		state = syntax_lex(j->syn, r, &j->hl[j->roff[i]], j->rsize[i],
+			j->rsize[i], 0, state);
+		j->end[i] = state;
+	}
+}
+/* Hand rendered row from job over to the row it was copied from.
+ */
+void editor_hl_install(struct hl_job *j, int i, erow *row)
+{
+	const unsigned char *hl = &j->hl[j->roff[i]];
+	editor_drop_render(row);
+	row->tabs = j->tabs[i];
+	row->rsize = j->rsize[i];
+	if(row->tabs > 0) {
+		row->render = slab_alloc(&e.slab, row->rsize+1);
+		memcpy(row->render, &j->render[j->roff[i]], row->rsize);
+		row->render[row->rsize] = '\0';
+		row->hl = slab_alloc(&e.slab, row->rsize+1);
+		memcpy(row->hl, hl, row->rsize);
+	} else {
+		/* highlight follows the gap of the row */
+		row->hl = slab_alloc(&e.slab, row->cap > 0 ? row->cap : 1);
+		memcpy(row->hl, hl, row->gap);
+		memcpy(&row->hl[row->gap+row->cap-row->size], &hl[row->gap],
+			row->size-row->gap);
+	}
+	e.render_bytes += editor_render_size(row);
+}
+/* Publish job results, rows changed in the meantime and everything
+ * lexed after them is thrown away.
+ */
+void editor_hl_publish(struct hl_job *j)
+{
+	int i;
+	if(j->row_gen != e.row_gen || j->hl_gen != e.hl_gen ||
+	    j->syn != e.syntax)
+		return;
+	if(j->from > 0 && !j->guess) {
+		erow *prev = editor_row(j->from-1);
+		if(!editor_hl_trusted(prev, j->from-1) ||
+		    prev->hl_end != j->state)
+			return;
+	}
+	for(i = 0; i < j->n; i++) {
+		int at = j->from+i;
+		erow *row = editor_row(at);
+		if(row->version != j->version[i]) break;
+		/* old highlight outside the window is replaced as well, it
+		 * must not pass as trusted once the end state is set */
+		if(row->hl != NULL ? !editor_hl_trusted(row, at) :
+		    at >= j->lo && at < j->hi)
+			editor_hl_install(j, i, row);
+		row->hl_end = j->end[i];
+		row->hl_gen = e.hl_gen;
+	}
 }
-/* Free copy buffer element.
+/* Background highlighting job, called by the worker with the lock held.
  */
-void editor_free_copy(ecopy *copy)
+int editor_hl_work(void *arg)
 {
-	free(copy->data);
+	struct hl_job *j = &hl_job;
+	if(e.num_rows == 0 || e.syntax == NULL) return 0;
+	if(!editor_hl_pick(j)) return 0;
+	worker_unlock();
+	editor_hl_lex(j);
+	worker_lock();
+	editor_hl_publish(j);
+	return 1;
 }
-/* Delete copy buffer element.
+/* Get rendered text of row built by editor_render_row().
  */
-void editor_delete_copy(int at)
+const char *editor_row_rendered(erow *row)
 {
-	if(at < 0 || at >= e.num_copy) return;
-	editor_free_copy(&e.copy[at]);
-	memmove(&e.copy[at], &e.copy[at+1], sizeof(ecopy)*(e.num_copy-at-1));
+	return row->render != NULL ? row->render : row->data;
 }
 /* Append to copy buffer.
  */
 void editor_insert_copy(int at, const char *s, size_t len)
 {
 	if(at < 0 || at > e.num_copy) return;
-	e.copy = realloc(e.copy, sizeof(ecopy)*(e.num_copy+1));
+	if(e.num_copy == e.copy_cap) {
+		e.copy_cap = e.copy_cap > 0 ? e.copy_cap*2 : 16;
+		e.copy = realloc(e.copy, sizeof(ecopy)*e.copy_cap);
+	}
 	memmove(&e.copy[at+1], &e.copy[at], sizeof(ecopy)*(e.num_copy-at));
-	e.copy[at].data = malloc(len+1);
+	e.copy[at].data = slab_alloc(&e.copy_slab, len+1);
 	e.copy[at].size = len;
 	memcpy(e.copy[at].data, s, len);
 	e.copy[at].data[len] = '\0';
 	e.num_copy++;
 }
-/* Undo from copy buffer.
+/* Record edit in the undo history and the crash recovery journal.
  */
-void editor_undo_copy(void)
+void editor_record(int op, int row, int col, const char *s, size_t len)
 {
-	void editor_insert_row(int at, const char *s, size_t len);
-	if(e.num_copy > 0) {
-		e.num_copy--;
-		editor_insert_row(e.cy, e.copy[e.num_copy].data, e.copy[e.num_copy].size);
-		editor_delete_copy(e.num_copy);
-	}
+	undo_record(&e.undo, op, row, col, s, len);
+	journal_add(&e.journal, op, row, col, s, len);
 }
 /* Paste from copy buffer.
  */
 void editor_paste_copy(void)
 {
-	void editor_insert_row(int at, const char *s, size_t len);
+	void editor_insert_rows(int at, const ecopy *rows, int k);
 	if(e.num_copy > 0) {
+		size_t len = 0;
+		char *s;
 		int i;
 
-		for(i = e.num_copy-1; i >= 0; i--)
-			editor_insert_row(e.cy, e.copy[i].data, e.copy[i].size);
+		for(i = 0; i < e.num_copy; i++)
+			len += e.copy[i].size+1;
+		/* the undo record holds the rows joined by new lines */
+		s = malloc(len);
+		for(i = 0, len = 0; i < e.num_copy; i++) {
+			memcpy(&s[len], e.copy[i].data, e.copy[i].size);
+			len += e.copy[i].size;
+			s[len++] = '\n';
+		}
+		editor_record(UNDO_ROWS_INSERT, e.cy, e.num_copy, s, len);
+		free(s);
+		editor_insert_rows(e.cy, e.copy, e.num_copy);
 	}
 }
+/* Add row without lexing it, the caller lexes the rows it added.
+ */
+void editor_add_row(int at, const char *s, size_t len)
+{
+	erow row;
+	editor_close_row();
+	row.size = len;
+	row.data = slab_alloc(&e.slab, slab_round(len+1));
+	memcpy(row.data, s, len);
+	row.data[len] = '\0';
+	row.rsize = 0;
+	row.render = NULL;
+	row.hl = NULL;
+	row.mapped = 0;
+	row.cap = slab_round(len+1);
+	row.gap = len;
+	row.tabs = -1;
+	row.hl_end = -1;
+	row.hl_gen = 0;
+	row.version = 0;
+	rows_insert(&e.rows, at, &row);
+	e.num_rows++;
+	e.row_gen++;
+	if(at < e.hl_stale_from && e.hl_stale_from != INT_MAX)
+		e.hl_stale_from++;
+	editor_dirty();
+}
 /* Append row to string.
  */
 void editor_insert_row(int at, const char *s, size_t len)
 {
 	if(at < 0 || at > e.num_rows) return;
-	e.row = realloc(e.row, sizeof(erow)*(e.num_rows+1));
-	memmove(&e.row[at+1], &e.row[at], sizeof(erow)*(e.num_rows-at));
-	e.row[at].size = len;
-	e.row[at].data = malloc(len+1);
-	memcpy(e.row[at].data, s, len);
-	e.row[at].data[len] = '\0';
-	e.row[at].rsize = 0;
-	e.row[at].render = NULL;
-	e.row[at].hl = NULL;
-	editor_update_row(&e.row[at]);
-	e.num_rows++;
-	e.dirty = 1;
+	editor_add_row(at, s, len);
+	editor_syntax_changed(at);
+}
+/* Add 'k' rows at 'at', lexing once for all of them.
+ */
+void editor_insert_rows(int at, const ecopy *rows, int k)
+{
+	int i;
+	if(at < 0 || at > e.num_rows || k <= 0) return;
+	for(i = 0; i < k; i++)
+		editor_add_row(at+i, rows[i].data, rows[i].size);
+	/* the first row lexed sees the unlexed ones and invalidates them */
+	editor_syntax_changed(at);
+}
+/* Add 'k' rows at 'at' given as text with a new line after each row.
+ */
+void editor_insert_joined(int at, const char *s, size_t len, int k)
+{
+	const char *end = s+len, *nl;
+	ecopy *rows;
+	int n = 0;
+	if(k <= 0) return;
+	rows = malloc(sizeof(ecopy)*k);
+	while(n < k && (nl = memchr(s, '\n', end-s)) != NULL) {
+		rows[n].data = (char *)s;
+		rows[n++].size = nl-s;
+		s = nl+1;
+	}
+	editor_insert_rows(at, rows, n);
+	free(rows);
+}
+/* Insert text at given position in row.
+ */
+void editor_row_insert_text(erow *row, int at, const char *s, int len)
+{
+	int i, tabs = 0;
+	if(at < 0 || at > row->size) at = row->size;
+	editor_row_gap(row, at, len);
+	memcpy(&row->data[row->gap], s, len);
+	row->gap += len;
+	row->size += len;
+	for(i = 0; i < len; i++)
+		if(s[i] == '\t') tabs++;
+	if(row->tabs >= 0) row->tabs += tabs;
+	if(row->hl != NULL && row->render == NULL && tabs == 0) {
+		/* highlight grew with the gap, the caller lexes the row again */
+		row->rsize = row->size;
+	} else {
+		editor_drop_render(row);
+	}
+	editor_dirty();
+}
+/* Delete text at given position in row.
+ */
+void editor_row_delete_text(erow *row, int at, int len)
+{
+	int i, tabs = 0;
+	if(at < 0 || len <= 0 || at+len > row->size) return;
+	editor_row_gap(row, at+len, 0);
+	row->gap -= len;
+	row->size -= len;
+	for(i = 0; i < len; i++)
+		if(row->data[row->gap+i] == '\t') tabs++;
+	if(row->gap == row->size) row->data[row->size] = '\0';
+	if(row->tabs > 0) row->tabs -= tabs;
+	if(row->hl != NULL && row->render == NULL) {
+		row->rsize = row->size;
+	} else {
+		editor_drop_render(row);
+	}
+	editor_dirty();
+}
+/* Get contiguous text of row from 'at' to 'at+len'.
+ */
+const char *editor_row_span(erow *row, int at, int len)
+{
+	if(row->gap < at+len) editor_row_gap(row, at+len, 0);
+	return &row->data[at];
 }
 /* Insert character at given position in row.
  */
 void editor_row_insert_char(erow *row, int at, int c)
 {
-	if(at < 0 || at > row->size) at = row->size;
-	row->data = realloc(row->data, row->size+2);
-	memmove(&row->data[at+1], &row->data[at], row->size-at+1);
-	row->size++;
-	row->data[at] = c;
-	editor_update_row(row);
-	e.dirty = 1;
+	char ch = c;
+	editor_row_insert_text(row, at, &ch, 1);
 }
 /* Delete character at given position.
  */
 void editor_row_delete_char(erow *row, int at)
 {
-	if(at < 0 || at >= row->size) return;
-	memmove(&row->data[at], &row->data[at+1], row->size-at);
-	row->size--;
-	editor_update_row(row);
-	e.dirty = 1;
+	editor_row_delete_text(row, at, 1);
 }
-/* Convert rows into one long string.
+/* Map regular file into memory and build lazy rows over it.
  */
-char *editor_rows_to_string(int *buflen)
+int editor_map(const char *filename)
 {
-	int i, total_len = 0;
-	char *buf, *p;
-	for(i = 0; i < e.num_rows; i++)
-		total_len += e.row[i].size+1;
-	if(buflen != NULL) *buflen = total_len;
-	buf = malloc(total_len);
-	p = &buf[0];
-	for(i = 0; i < e.num_rows; i++) {
-		memcpy(p, e.row[i].data, e.row[i].size);
-		p += e.row[i].size;
-		*p = '\n';
-		p++;
+	struct stat st;
+	lineidx idx;
+	char *map;
+	int fd;
+	fd = open(filename, O_RDONLY);
+	if(fd < 0) return -1;
+	if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return -1;
 	}
-	return buf;
+	if(st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	if(lineidx_build(&idx, map, st.st_size, ROWS_LEAF_MAX) < 0) {
+		munmap(map, st.st_size);
+		close(fd);
+		return -1;
+	}
+	/* kept open so saves can copy untouched text file to file */
+	e.map = map;
+	e.map_len = st.st_size;
+	e.map_fd = fd;
+	e.num_rows = rows_map(&e.rows, map, st.st_size, idx.start,
+		(int)idx.lines);
+	lineidx_free(&idx);
+	return 0;
 }
 /* Open given 'filename' in editor.
  */
@@ -373,126 +1066,854 @@ void editor_open(const char *filename)
 	ssize_t line_len;
 	int length = 0;
 	FILE *fp;
+	void editor_journal_open(const char *filename);
 	length = strlen(filename);
 	memcpy(fname, filename, length);
 	fname[length] = '\0';
 	e.filename = &fname[0];
-	fp = fopen(filename, "r");
-	if(fp == NULL) die("editor_open()");
-	while((line_len = getline(&line, &line_cap, fp)) > 0) {
-		while(line_len > 0 && (line[line_len-1] == '\n' ||
-				       line[line_len-1] == '\r'))
-			line_len--;
-		editor_insert_row(e.num_rows, line, line_len);
-	}
-	free(line);
-	fclose(fp);
+	if(editor_map(filename) < 0) {
+		fp = fopen(filename, "r");
+		if(fp == NULL) die("editor_open()");
+		while((line_len = getline(&line, &line_cap, fp)) > 0) {
+			while(line_len > 0 && (line[line_len-1] == '\n' ||
+					       line[line_len-1] == '\r'))
+				line_len--;
+			editor_insert_row(e.num_rows, line, line_len);
+		}
+		free(line);
+		fclose(fp);
+	}
+	editor_select_syntax();
 	e.dirty = 0;
+	editor_journal_open(filename);
 #undef MAX_PATH
 }
-/* Save text file to disk.
+/* Apply edit replayed from the journal once it is known to fit.
+ */
+int editor_replay(void *arg, int op, int row, int col, const char *s,
+	size_t len)
+{
+	void editor_apply(int op, int row, int col, const char *s, size_t len);
+	erow *r = (row >= 0 && row < e.num_rows) ? editor_row(row) : NULL;
+	switch(op) {
+	case UNDO_INSERT:
+	case UNDO_SPLIT:
+		if(r == NULL || col < 0 || col > r->size) return -1;
+	break;
+	case UNDO_DELETE:
+		if(r == NULL || col < 0 || (size_t)(r->size-col) < len)
+			return -1;
+	break;
+	case UNDO_JOIN:
+		if(r == NULL || row+1 >= e.num_rows) return -1;
+	break;
+	case UNDO_ROW_DELETE:
+		if(r == NULL) return -1;
+	break;
+	case UNDO_ROW_INSERT:
+		if(row < 0 || row > e.num_rows) return -1;
+	break;
+	case UNDO_ROWS_DELETE:
+		if(r == NULL || col <= 0 || col > e.num_rows-row) return -1;
+	break;
+	case UNDO_ROWS_INSERT:
+		if(row < 0 || row > e.num_rows || col <= 0) return -1;
+	break;
+	default:
+		return -1;
+	}
+	/* recovered edits can be taken back like any other */
+	undo_record(&e.undo, op, row, col, s, len);
+	editor_apply(op, row, col, s, len);
+	return 0;
+}
+/* Get crash recovery journal path of file, a hidden file beside it.
+ */
+char *editor_journal_path(const char *path)
+{
+	const char *base = strrchr(path, '/');
+	size_t dir = (base != NULL) ? base+1-path : 0;
+	char *j = malloc(strlen(path)+16);
+	memcpy(j, path, dir);
+	sprintf(j+dir, ".%s.prsed", path+dir);
+	return j;
+}
+/* Start crash recovery journal of file, replaying edits a crash lost.
+ */
+void editor_journal_open(const char *filename)
+{
+	char id[JOURNAL_ID], *path, *jpath;
+	long n;
+	path = realpath(filename, NULL);
+	if(path == NULL) return;
+	jpath = editor_journal_path(path);
+	journal_ident(path, id);
+	journal_start(&e.journal, jpath, id);
+	free(jpath);
+	free(path);
+	undo_step(&e.undo);
+	n = journal_replay(&e.journal, editor_replay, NULL);
+	if(n > 0) {
+		editor_set_status("Recovered %ld unsaved edits from the journal.",
+			n);
+	}
+}
+/* Drop crash recovery journal, unsaved edits were thrown away.
+ */
+void editor_journal_drop(void)
+{
+	worker_hold();
+	journal_close(&e.journal, 0);
+	worker_release();
+}
+/* Background job writing journal records that waited long enough,
+ * called with the lock held.
+ */
+int editor_journal_work(void)
+{
+	if(!journal_due(&e.journal)) return 0;
+	journal_take(&e.journal);
+	worker_unlock();
+	journal_write(&e.journal);
+	worker_lock();
+	/* the event loop waits for this write before timing the next one */
+	event_wake();
+	return 1;
+}
+/* Add piece to save snapshot, joined to the last one when they touch.
+ */
+void editor_save_piece(esave *sv, int kind, size_t off, size_t len)
+{
+	epiece *last = sv->n > 0 ? &sv->piece[sv->n-1] : NULL;
+	if(len == 0) return;
+	sv->total += len;
+	if(last != NULL && last->kind == kind && last->off+last->len == off) {
+		last->len += len;
+		return;
+	}
+	if(sv->n == sv->cap) {
+		sv->cap = sv->cap > 0 ? sv->cap*2 : 256;
+		sv->piece = realloc(sv->piece, sizeof(epiece)*sv->cap);
+	}
+	sv->piece[sv->n].kind = kind;
+	sv->piece[sv->n].off = off;
+	sv->piece[sv->n].len = len;
+	sv->n++;
+}
+/* Copy text into save snapshot.
+ */
+void editor_save_own(esave *sv, const char *s, size_t len)
+{
+	if(sv->own_cap-sv->own_len < len) {
+		size_t cap = sv->own_cap*2;
+		if(cap < sv->own_len+len) cap = sv->own_len+len+4096;
+		sv->own = realloc(sv->own, cap);
+		sv->own_cap = cap;
+	}
+	memcpy(&sv->own[sv->own_len], s, len);
+	editor_save_piece(sv, SAVE_OWN, sv->own_len, len);
+	sv->own_len += len;
+}
+/* Take snapshot of the document, text in the file mapping never changes
+ * so only rows edited since it was opened are copied.
+ */
+void editor_save_snapshot(esave *sv)
+{
+	rownode *n;
+	int i;
+	editor_close_row();
+	for(n = e.rows.first; n != NULL; n = n->next) {
+		if(n->row == NULL) {
+			editor_save_piece(sv, SAVE_LINES, n->map-e.map, n->map_len);
+			continue;
+		}
+		for(i = 0; i < n->n; i++) {
+			erow *row = &n->row[i];
+			size_t off;
+			if(!row->mapped) {
+				editor_save_own(sv, row->data, row->size);
+				editor_save_own(sv, "\n", 1);
+				continue;
+			}
+			/* text still in the mapping brings its own newline */
+			off = row->data-e.map;
+			if(off+row->size < e.map_len && row->data[row->size] == '\n') {
+				editor_save_piece(sv, SAVE_MAP, off, row->size+1);
+			} else {
+				editor_save_piece(sv, SAVE_MAP, off, row->size);
+				editor_save_own(sv, "\n", 1);
+			}
+		}
+	}
+}
+/* Write text gathered by save.
+ */
+int editor_save_flush(esave *sv)
+{
+	struct iovec *iov = sv->iov;
+	int n = sv->niov;
+	sv->niov = 0;
+	while(n > 0) {
+		ssize_t w = writev(sv->fd, iov, n);
+		if(w < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		while(n > 0 && (size_t)w >= iov->iov_len) {
+			w -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if(n > 0) {
+			iov->iov_base = (char*)iov->iov_base+w;
+			iov->iov_len -= w;
+		}
+	}
+	return 0;
+}
+/* Gather text for writev(), joined to the last piece when they touch.
+ */
+int editor_save_add(esave *sv, const char *p, size_t len)
+{
+	struct iovec *last = sv->niov > 0 ? &sv->iov[sv->niov-1] : NULL;
+	if(len == 0) return 0;
+	sv->written += len;
+	if(last != NULL && (const char*)last->iov_base+last->iov_len == p) {
+		last->iov_len += len;
+		return 0;
+	}
+	if(sv->niov == PRSED_SAVE_IOV && editor_save_flush(sv) < 0)
+		return -1;
+	sv->iov[sv->niov].iov_base = (char*)p;
+	sv->iov[sv->niov].iov_len = len;
+	sv->niov++;
+	return 0;
+}
+/* Copy text of the file mapping file to file without reading it in.
+ */
+int editor_save_copy(esave *sv, size_t at, size_t len)
+{
+	off_t off = at;
+	if(editor_save_flush(sv) < 0) return -1;
+	sv->written += len;
+#ifdef __linux__
+	while(len > 0) {
+		loff_t in = off;
+		ssize_t w = copy_file_range(e.map_fd, &in, sv->fd, NULL, len, 0);
+		if(w < 0 && errno == EINTR) continue;
+		if(w <= 0) break;
+		off += w;
+		len -= w;
+	}
+	/* older kernels refuse copies across file systems */
+	while(len > 0) {
+		ssize_t w = sendfile(sv->fd, e.map_fd, &off, len);
+		if(w < 0 && errno == EINTR) continue;
+		if(w <= 0) break;
+		len -= w;
+	}
+#endif
+	while(len > 0) {
+		ssize_t w = write(sv->fd, e.map+off, len);
+		if(w < 0 && errno == EINTR) continue;
+		if(w <= 0) return -1;
+		off += w;
+		len -= w;
+	}
+	return 0;
+}
+/* Write mapped lines from 'p' up to the first line end after 'want'
+ * bytes, return bytes of 'p' used or -1 on error.
+ */
+long editor_save_lines(esave *sv, const char *p, size_t len, size_t want)
+{
+	static const char nl = '\n';
+	const char *end = p+len, *q = p+(want < len ? want : len), *s;
+	if(q < end) {
+		const char *c = memchr(q, '\n', end-q);
+		q = (c != NULL) ? c+1 : end;
+	}
+	/* whole lines without '\r' are written back as they are */
+	if(q[-1] == '\n' && memchr(p, '\r', q-p) == NULL)
+		return editor_save_copy(sv, p-e.map, q-p) < 0 ? -1 : q-p;
+	for(s = p; s < q; ) {
+		const char *c = memchr(s, '\n', q-s);
+		const char *t = (c != NULL) ? c : q;
+		while(t > s && t[-1] == '\r') t--;
+		if(c != NULL && t == c) {
+			if(editor_save_add(sv, s, c-s+1) < 0) return -1;
+		} else if(editor_save_add(sv, s, t-s) < 0 ||
+		    editor_save_add(sv, &nl, 1) < 0) {
+			return -1;
+		}
+		s = (c != NULL) ? c+1 : q;
+	}
+	return q-p;
+}
+/* Write next part of the snapshot, called without the lock.
+ */
+int editor_save_write(esave *sv)
+{
+	size_t budget = PRSED_SAVE_STEP;
+	while(sv->at < sv->n && budget > 0) {
+		epiece *pc = &sv->piece[sv->at];
+		const char *p = (pc->kind == SAVE_OWN ? sv->own : e.map)+
+			pc->off+sv->skip;
+		size_t len = pc->len-sv->skip;
+		if(pc->kind == SAVE_LINES) {
+			long got = editor_save_lines(sv, p, len, budget);
+			if(got < 0) return -1;
+			len = got;
+		} else {
+			if(len > budget) len = budget;
+			if(editor_save_add(sv, p, len) < 0) return -1;
+		}
+		sv->skip += len;
+		sv->done += len;
+		budget -= len < budget ? len : budget;
+		if(sv->skip == pc->len) {
+			sv->at++;
+			sv->skip = 0;
+		}
+	}
+	return editor_save_flush(sv);
+}
+/* Give new file the permissions of the one it replaces.
+ */
+void editor_save_mode(int fd, const char *path)
+{
+	struct stat st;
+	if(stat(path, &st) == 0) {
+		fchmod(fd, st.st_mode & 07777);
+		if(fchown(fd, st.st_uid, st.st_gid) < 0) {
+			/* not ours to give away, keep our own owner */
+		}
+	} else {
+		mode_t mask = umask(0);
+		umask(mask);
+		fchmod(fd, 0644 & ~mask);
+	}
+}
+/* Flush directory entry of file to disk.
+ */
+void editor_sync_dir(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	char *dir;
+	int fd;
+	if(slash == NULL) {
+		dir = strdup(".");
+	} else {
+		dir = malloc(slash-path+2);
+		memcpy(dir, path, slash-path+1);
+		dir[slash-path+1] = '\0';
+	}
+	fd = open(dir, O_RDONLY);
+	if(fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+	free(dir);
+}
+/* Finish file of save, moving it over the old one unless 'err' is set.
+ * Returns error number.
+ */
+int editor_save_close(esave *sv, int err)
+{
+	if(err == 0 && fsync(sv->fd) < 0) err = errno;
+	if(close(sv->fd) < 0 && err == 0) err = errno;
+	/* the old file stays whole until the new one replaces it */
+	if(err == 0 && rename(sv->tmp, sv->path) < 0) err = errno;
+	if(err != 0) unlink(sv->tmp);
+	else editor_sync_dir(sv->path);
+	return err;
+}
+/* Point crash recovery journal at the file a save replaced.
+ */
+void editor_journal_saved(esave *sv)
+{
+	char id[JOURNAL_ID], *jpath = editor_journal_path(sv->path);
+	journal_ident(sv->path, id);
+	if(e.journal.path != NULL && strcmp(e.journal.path, jpath) == 0) {
+		journal_saved(&e.journal, sv->jseq, id, e.edit_gen == sv->gen);
+	} else {
+		/* saved under a new name, the old journal is of no use */
+		journal_close(&e.journal, 0);
+		journal_start(&e.journal, jpath, id);
+	}
+	free(jpath);
+}
+/* Report finished save and free its snapshot.
+ */
+void editor_save_end(esave *sv, int err)
+{
+	if(err == 0) {
+		/* edits made while saving keep the document modified */
+		if(e.edit_gen == sv->gen) e.dirty = 0;
+		editor_journal_saved(sv);
+		editor_set_status("%lu bytes written to disk.",
+			(unsigned long)sv->written);
+	} else {
+		editor_set_status("Can't save! I/O error: %s", strerror(err));
+	}
+	free(sv->piece);
+	free(sv->own);
+	free(sv->path);
+	free(sv->tmp);
+	sv->piece = NULL;
+	sv->own = NULL;
+	sv->path = sv->tmp = NULL;
+	sv->n = sv->cap = 0;
+	sv->own_len = sv->own_cap = 0;
+	sv->active = 0;
+	sv->pct = -1;
+}
+/* Background save job, called with the lock held, returns nonzero while
+ * a save is running.
+ */
+int editor_save_work(void)
+{
+	esave *sv = &e.save;
+	int err = 0, done;
+	if(!sv->active) return 0;
+	/* nothing the editor does touches the snapshot or the mapping */
+	worker_unlock();
+	if(editor_save_write(sv) < 0) err = errno != 0 ? errno : EIO;
+	done = err != 0 || sv->at == sv->n;
+	if(done) err = editor_save_close(sv, err);
+	worker_lock();
+	if(done) editor_save_end(sv, err);
+	else sv->pct = (int)(sv->done*100/sv->total);
+	/* show how far it got */
+	event_wake();
+	return 1;
+}
+/* Finish running save in the foreground, worker held.
+ */
+void editor_save_finish(void)
+{
+	while(editor_save_work())
+		;
+}
+/* Background job, a running save goes before highlighting.
+ */
+int editor_work(void *arg)
+{
+	if(editor_journal_work()) return 1;
+	if(editor_save_work()) return 1;
+	return editor_hl_work(arg);
+}
+/* Save text file to disk in the background.
  */
 void editor_save()
 {
-	char *buf;
-	int len, fd;
+	esave *sv = &e.save;
+	char *path, *tmp;
+	int fd;
+	if(sv->active) {
+		editor_set_status("Still saving, wait for it to finish.");
+		return;
+	}
 	if(e.filename == NULL) {
 		e.filename = editor_prompt("Save as (ESC to cancel): %s", NULL);
 		if(e.filename == NULL) {
 			editor_set_status("Save aborted!");
 			return;
 		}
+		editor_select_syntax();
+	}
+	/* write next to the file a symbolic link points at */
+	path = realpath(e.filename, NULL);
+	if(path == NULL) path = strdup(e.filename);
+	tmp = malloc(strlen(path)+8);
+	sprintf(tmp, "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if(fd < 0) {
+		editor_set_status("Can't save! I/O error: %s", strerror(errno));
+		free(tmp);
+		free(path);
+		return;
 	}
-	buf = editor_rows_to_string(&len);
-	if(buf == NULL) return;
-	fd = open(e.filename, O_RDWR | O_CREAT, 0644);
-	if(fd != -1) {
-		if(ftruncate(fd, len) != -1) {
-			if(write(fd, buf, len) == len) {
-				close(fd);
-				free(buf);
-				e.dirty = 0;
-				editor_set_status("%d bytes written to disk.",
-					len);
-				return;
+	editor_save_mode(fd, path);
+	sv->fd = fd;
+	sv->path = path;
+	sv->tmp = tmp;
+	sv->at = sv->skip = 0;
+	sv->done = sv->total = sv->written = 0;
+	sv->niov = 0;
+	sv->gen = e.edit_gen;
+	sv->jseq = journal_save(&e.journal);
+	editor_save_snapshot(sv);
+	sv->active = 1;
+	sv->pct = 0;
+	worker_kick();
+}
+/* Count match of find-all job, keeping it when inside the job window.
+ */
+void editor_search_add(struct search_job *j, const char *text, int len,
+	int row, int col, int mlen)
+{
+	size_t ord = j->total++;
+	if(row < j->orow || (row == j->orow && col < j->ocol))
+		j->before++;
+	if(ord < j->lo || ord-j->lo >= j->keep) return;
+	if(j->n == j->cap) {
+		j->cap = j->cap ? j->cap*2 : 256;
+		j->m = realloc(j->m, sizeof(ematch)*j->cap);
+	}
+	j->m[j->n].text = text;
+	j->m[j->n].len = len;
+	j->m[j->n].row = row;
+	j->m[j->n].col = col;
+	j->m[j->n].mlen = mlen;
+	j->n++;
+}
+/* Count regex match in row being scanned.
+ */
+void editor_search_hit(void *arg, size_t at, size_t len)
+{
+	struct search_row *r = arg;
+	editor_search_add(r->j, r->text, r->len, r->row, at, len);
+}
+/* Scan row text with the regex matcher.
+ */
+void editor_search_regex(struct search_job *j, const char *text, int len,
+	int row)
+{
+	struct search_row r;
+	r.j = j;
+	r.text = text;
+	r.len = len;
+	r.row = row;
+	dfa_find_all(j->re, text, len, editor_search_hit, &r);
+}
+/* Scan lazy leaf for regex matches in the file mapping, only the lines
+ * holding the literal the pattern starts with are matched.
+ */
+void editor_search_mapped_regex(struct search_job *j, const rownode *n,
+	int base)
+{
+	const finder *pre = dfa_prefilter(j->re);
+	const char *p = n->map, *end = n->map+n->map_len, *line = p, *nl, *m;
+	int row = base;
+	while(line < end) {
+		const char *eol;
+		if(pre != NULL) {
+			m = search_find_from(pre, p, end-p, line-p);
+			if(m == NULL) break;
+			while((nl = memchr(line, '\n', m-line)) != NULL) {
+				line = nl+1;
+				row++;
 			}
 		}
-		close(fd);
+		nl = memchr(line, '\n', end-line);
+		eol = (nl != NULL) ? nl : end;
+		while(eol > line && eol[-1] == '\r') eol--;
+		editor_search_regex(j, line, eol-line, row);
+		if(nl == NULL) break;
+		line = nl+1;
+		row++;
 	}
-	free(buf);
-	editor_set_status("Can't save! I/O error: %s", strerror(errno));
 }
-/* Callback for searching in the editor.
+/* Scan lazy leaf for every match straight in the file mapping.
  */
-void editor_search_callback(const char *query, int key)
+void editor_search_mapped(struct search_job *j, const rownode *n, int base)
+{
+	const char *p = n->map, *end = n->map+n->map_len;
+	const char *line = p, *eol = NULL, *m, *nl;
+	int row = base;
+	size_t at = 0;
+	if(j->re != NULL) {
+		editor_search_mapped_regex(j, n, base);
+		return;
+	}
+	while((m = search_find_from(j->f, p, end-p, at)) != NULL) {
+		/* rows of a lazy leaf follow each other in the mapping */
+		while((nl = memchr(line, '\n', m-line)) != NULL) {
+			line = nl+1;
+			eol = NULL;
+			row++;
+		}
+		if(eol == NULL) {
+			eol = memchr(line, '\n', end-line);
+			if(eol == NULL) eol = end;
+			while(eol > line && eol[-1] == '\r') eol--;
+		}
+		editor_search_add(j, line, eol-line, row, m-line, j->f->len);
+		at = m-p+1;
+	}
+}
+/* Run find-all job over its leaves (pool thread).
+ */
+void editor_search_leaves(void *arg, int worker)
+{
+	struct search_job *j = arg;
+	rownode *n = j->first;
+	int k, base = j->base;
+	if(j->res != NULL) j->re = j->res[worker];
+	j->n = 0;
+	j->total = 0;
+	j->before = 0;
+	for(k = 0; k < j->leaves; k++, base += n->n, n = n->next) {
+		int i;
+		if(n->row == NULL) {
+			editor_search_mapped(j, n, base);
+			continue;
+		}
+		for(i = 0; i < n->n; i++) {
+			erow *row = &n->row[i];
+			const char *m;
+			size_t at = 0;
+			if(j->re != NULL) {
+				editor_search_regex(j, row->data, row->size, base+i);
+				continue;
+			}
+			while((m = search_find_from(j->f, row->data, row->size, at))
+			    != NULL) {
+				editor_search_add(j, row->data, row->size, base+i,
+					m-row->data, j->f->len);
+				at = m-row->data+1;
+			}
+		}
+	}
+}
+/* Find every match of the session query with the document split over
+ * the thread pool; the jobs come back in document order so their
+ * matches join into one sorted index, the window of which starts at
+ * match number 'lo'.
+ */
+void editor_search_scan(esearch *se, const finder *f, dfa *re, size_t lo)
 {
-	int editor_row_rx_to_cx(erow *, int);
-	static int last_match = -1;
-	static int direction = -1;
-	static int saved_hl_line;
-	static char *saved_hl = NULL;
+	struct search_job *job;
+	dfa *res[POOL_MAX_THREADS];
+	rownode *n;
+	size_t at;
+	int i, njob = 0, base = 0, leaves = 0, threads;
+	se->n = 0;
+	se->lo = lo;
+	se->total = 0;
+	se->before = 0;
+	if(se->qlen == 0) return;
+	for(n = e.rows.first; n != NULL; n = n->next)
+		leaves++;
+	njob = (leaves+PRSED_SEARCH_LEAVES-1)/PRSED_SEARCH_LEAVES;
+	job = calloc(njob, sizeof(struct search_job));
+	if(job == NULL) return;
+	/* the automata grow as they run, every worker past the caller gets
+	 * its own copy */
+	threads = pool_threads();
+	if(threads > njob) threads = njob;
+	res[0] = re;
+	for(i = 1; i < threads; i++)
+		res[i] = (re != NULL) ? dfa_clone(re) : NULL;
+	for(i = 0, n = e.rows.first; i < njob; i++) {
+		int k;
+		job[i].f = f;
+		job[i].re = re;
+		job[i].res = (re != NULL) ? res : NULL;
+		job[i].first = n;
+		job[i].base = base;
+		job[i].orow = se->orow;
+		job[i].ocol = se->ocol;
+		job[i].keep = PRSED_SEARCH_MAX/njob;
+		for(k = 0; k < PRSED_SEARCH_LEAVES && n != NULL; k++) {
+			base += n->n;
+			n = n->next;
+		}
+		job[i].leaves = k;
+	}
+	pool_run(editor_search_leaves, job, sizeof(struct search_job), njob);
 
-	/* restore original syntax highlighting */
-	if(saved_hl != NULL) {
-		memcpy(e.row[saved_hl_line].hl, saved_hl, e.row[saved_hl_line].rsize);
-		free(saved_hl);
-		saved_hl = NULL;
+	/* merge the job windows, rerunning a job that kept too few */
+	for(i = 0, at = 0; i < njob; at += job[i].total, i++) {
+		struct search_job *j = &job[i];
+		size_t from = lo > at ? lo-at : 0, want;
+		se->total += j->total;
+		se->before += j->before;
+		if(from >= j->total || se->n == PRSED_SEARCH_MAX) continue;
+		want = j->total-from;
+		if(want > PRSED_SEARCH_MAX-se->n) want = PRSED_SEARCH_MAX-se->n;
+		if(from < j->lo || from+want > j->lo+j->n) {
+			j->lo = from;
+			j->keep = want;
+			editor_search_leaves(j, 0);
+		}
+		if(se->n+want > se->cap) {
+			se->cap = se->n+want;
+			se->m = realloc(se->m, sizeof(ematch)*se->cap);
+		}
+		memcpy(&se->m[se->n], &j->m[from-j->lo], sizeof(ematch)*want);
+		se->n += want;
+	}
+	for(i = 1; i < threads; i++)
+		if(res[i] != NULL) dfa_absorb(re, res[i]);
+	for(i = 0; i < njob; i++)
+		free(job[i].m);
+	free(job);
+}
+/* Index of first match in the session window at or after row and
+ * column, binary search over the sorted window.
+ */
+size_t editor_search_lookup(const esearch *se, int row, int col)
+{
+	size_t lo = 0, hi = se->n;
+	while(lo < hi) {
+		size_t mid = lo+(hi-lo)/2;
+		const ematch *m = &se->m[mid];
+		if(m->row < row || (m->row == row && m->col < col))
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+/* Keep only the matches that still match the longer query.
+ */
+void editor_search_narrow(esearch *se, const finder *f)
+{
+	size_t i, k = 0;
+	se->before = 0;
+	for(i = 0; i < se->n; i++) {
+		ematch *m = &se->m[i];
+		if(!search_match_at(f, m->text, m->len, m->col)) continue;
+		if(m->row < se->orow || (m->row == se->orow && m->col < se->ocol))
+			se->before++;
+		se->m[k++] = *m;
+	}
+	se->n = k;
+	se->total = k;
+}
+/* Scan the document for the session query, regular expressions come
+ * compiled from the pattern cache so a pattern seen before in this
+ * session keeps the automaton states it already built.
+ */
+void editor_search_run(esearch *se, size_t lo)
+{
+	finder f;
+	dfa *re;
+	se->error = NULL;
+	if(se->flags & SEARCH_REGEX) {
+		se->n = se->total = se->before = 0;
+		if(se->qlen == 0) return;
+		re = dfa_cache_get(se->query, se->qlen, se->flags, &se->error);
+		if(re != NULL) editor_search_scan(se, NULL, re, lo);
+		return;
+	}
+	if(search_compile(&f, se->query, se->qlen, se->flags) < 0) return;
+	editor_search_scan(se, &f, NULL, lo);
+	search_free(&f);
+}
+/* Bring match number 'ord' into the session window, rescanning only
+ * when the window holds fewer matches than the document.
+ */
+ematch *editor_search_at(esearch *se, size_t ord)
+{
+	if(ord < se->lo || ord-se->lo >= se->n) {
+		editor_search_run(se, ord >= PRSED_SEARCH_MAX/2 ?
+			ord-PRSED_SEARCH_MAX/2 : 0);
+		if(ord < se->lo || ord-se->lo >= se->n) return NULL;
 	}
+	se->cur = ord;
+	return &se->m[ord-se->lo];
+}
+/* Update session for new query, narrowing the last match set when the
+ * query only grew and every match of the old one is known.
+ */
+void editor_search_update(esearch *se, const char *query, int flags)
+{
+	size_t len = strlen(query);
+	int grew;
+	finder f;
+	if(len >= sizeof(se->query)) len = sizeof(se->query)-1;
+	if(len == se->qlen && flags == se->flags &&
+	    memcmp(query, se->query, len) == 0)
+		return;
+	/* whole word matches of a longer query need not be ones of this,
+	 * neither do matches of a longer regular expression */
+	grew = len > se->qlen && flags == se->flags &&
+		!(flags & (SEARCH_WORD|SEARCH_REGEX)) && se->qlen > 0 &&
+		se->lo == 0 && se->n == se->total &&
+		memcmp(query, se->query, se->qlen) == 0;
+	memcpy(se->query, query, len);
+	se->query[len] = '\0';
+	se->qlen = len;
+	se->flags = flags;
+	if(!grew) {
+		editor_search_run(se, 0);
+	} else if(search_compile(&f, se->query, se->qlen, se->flags) == 0) {
+		editor_search_narrow(se, &f);
+		search_free(&f);
+	}
+}
+/* Close search session.
+ */
+void editor_search_end(esearch *se)
+{
+	dfa_cache_clear();
+	free(se->m);
+	memset(se, 0, sizeof(esearch));
+}
+/* Fill search prompt with the active search options.
+ */
+const char *editor_search_msg(void)
+{
+	sprintf(e.search_msg, "Search%s%s%s (ESC/Arrows/Enter/^T/^W/^R): %%s",
+		(e.search_flags & SEARCH_ICASE) ? " [nocase]" : "",
+		(e.search_flags & SEARCH_WORD) ? " [word]" : "",
+		(e.search_flags & SEARCH_REGEX) ? " [regex]" : "");
+	return e.search_msg;
+}
+/* Callback for searching in the editor.
+ */
+void editor_search_callback(const char *query, int key)
+{
+	esearch *se = &e.search;
+	ematch *m = NULL;
 
-	/* controlling search */
+	/* controlling search, arrows step through the known matches */
 	if(key == '\r' || key == '\x1b') {
-		last_match = -1;
-		direction = 1;
+		editor_search_end(se);
 		return;
-	} else if(key == ARROW_DOWN) {
-		direction = 1;
-	} else if(key == ARROW_UP) {
-		direction = -1;
+	} else if(key == ARROW_DOWN || key == ARROW_UP) {
+		if(se->total == 0) return;
+		if(key == ARROW_DOWN)
+			m = editor_search_at(se, (se->cur+1)%se->total);
+		else
+			m = editor_search_at(se, (se->cur+se->total-1)%se->total);
 	} else {
-		last_match = -1;
-		direction = 1;
+		if(key == CTRL_KEY('t')) e.search_flags ^= SEARCH_ICASE;
+		else if(key == CTRL_KEY('w')) e.search_flags ^= SEARCH_WORD;
+		else if(key == CTRL_KEY('r')) e.search_flags ^= SEARCH_REGEX;
+		editor_search_msg();
+		editor_search_update(se, query, e.search_flags);
+		/* first match from where the search started */
+		if(se->total > 0)
+			m = editor_search_at(se, se->before < se->total ?
+				se->before : 0);
 	}
 
-	/* search for something */
-	if(last_match == -1) direction = 1;
-	{
-		int current = last_match;
-		int i;
-		for(i = 0; i < e.num_rows; i++) {
-			current += direction;
-			if(current == -1) current = e.num_rows-1;
-			else if(current == e.num_rows) current = 0;
-			{
-				erow *row = &e.row[current];
-				char *match = strstr(row->render, query);
-				if(match != NULL) {
-					last_match = current;
-					e.cy = current;
-					e.cx = editor_row_rx_to_cx(row, match-row->render);
-					e.row_off = e.num_rows;
-					/* save original syntax highlighting */
-					saved_hl_line = current;
-					saved_hl = malloc(row->rsize);
-					memcpy(saved_hl, row->hl, row->rsize);
-					/* highlight search result */
-					memset(&row->hl[match-row->render], HL_MATCH, strlen(query));
-					break;
-				}
-			}
-		}
+	/* every match on screen is marked when the rows are drawn */
+	if(m != NULL) {
+		e.cy = m->row;
+		e.cx = m->col;
+		e.row_off = e.num_rows;
 	}
 }
 /* Search for string in current text.
  */
 void editor_search()
 {
-	extern int editor_row_rx_to_cx(erow *row, int rx);
 	int saved_cx = e.cx;
 	int saved_cy = e.cy;
 	int saved_col_off = e.col_off;
 	int saved_row_off = e.row_off;
-	char *query = editor_prompt("Search (Use ESC/Arrows/Enter): %s",
-		editor_search_callback);
+	char *query;
+	editor_close_row();
+	editor_search_end(&e.search);
+	e.search.active = 1;
+	e.search.orow = e.cy;
+	e.search.ocol = e.cx;
+	query = editor_prompt(editor_search_msg(), editor_search_callback);
 	if(query == NULL) {
 		editor_set_status("Search aborted!");
 		e.cx = saved_cx;
@@ -506,104 +1927,307 @@ void editor_search()
  */
 void editor_free_row(erow *row)
 {
-	free(row->render);
-	free(row->data);
-	free(row->hl);
+	editor_drop_render(row);
+	if(!row->mapped) slab_free(&e.slab, row->data, row->cap);
 }
 /* Delete row from buffer.
  */
 void editor_delete_row(int at)
 {
-	if(at < 0 || at >= e.num_rows) return;
-	editor_free_row(&e.row[at]);
-	memmove(&e.row[at], &e.row[at+1], sizeof(erow)*(e.num_rows-at-1));
-	e.num_rows--;
-	e.dirty = 1;
+	void editor_delete_rows(int at, int k);
+	editor_delete_rows(at, 1);
+}
+/* Delete 'k' rows from 'at', lexing once for all of them.
+ */
+void editor_delete_rows(int at, int k)
+{
+	int i;
+	if(at < 0 || k <= 0 || at+k > e.num_rows) return;
+	editor_close_row();
+	for(i = 0; i < k; i++) {
+		editor_free_row(editor_row(at));
+		rows_delete(&e.rows, at);
+	}
+	e.num_rows -= k;
+	e.row_gen++;
+	if(at < e.hl_stale_from && e.hl_stale_from != INT_MAX)
+		e.hl_stale_from = (at+k < e.hl_stale_from) ?
+			e.hl_stale_from-k : at;
+	editor_syntax_changed(at);
+	editor_dirty();
 }
 /* Append a string to the end of a row.
  */
 void editor_row_append_string(erow *row, char *s, size_t len)
 {
-	row->data = realloc(row->data, row->size+len+1);
+	editor_row_gap(row, row->size, len);
 	memcpy(&row->data[row->size], s, len);
 	row->size += len;
+	row->gap = row->size;
 	row->data[row->size] = '\0';
-	editor_update_row(row);
-	e.dirty = 1;
+	row->tabs = -1;
+	editor_drop_render(row);
+	editor_dirty();
 }
-/* Structure for append buffer. */
-struct abuf {
-	char *b;
-	int len;
-};
-/* Initial append buffer */
-#define ABUF_INIT	{NULL, 0}
-/* Create/Append to append buffer.
+/* Break row in two at column.
  */
-void ab_append(struct abuf *ab, const char *s, int len)
+void editor_split_row(int at, int col)
 {
-	ab->b = realloc(ab->b, ab->len+len);
-	memcpy(&ab->b[ab->len], s, len);
-	ab->len += len;
+	if(col == 0) {
+		editor_insert_row(at, "", 0);
+	} else {
+		erow *row = editor_row(at);
+		editor_row_flat(row);
+		editor_insert_row(at+1, &row->data[col], row->size-col);
+		row = editor_row(at);
+		editor_row_own(row);
+		row->size = col;
+		row->gap = row->size;
+		row->version++;
+		row->data[row->size] = '\0';
+		row->tabs = -1;
+		editor_drop_render(row);
+		editor_syntax_changed(at);
+	}
 }
-/* Free append buffer.
+/* Append next row to row and delete it.
  */
-void ab_free(struct abuf *ab)
+void editor_join_row(int at)
 {
-	free(ab->b);
+	erow *row = editor_row(at+1);
+	editor_row_flat(row);
+	editor_row_append_string(editor_row(at), row->data, row->size);
+	editor_delete_row(at+1);
+	editor_syntax_changed(at);
 }
 /* Insert character into row at index.
  */
 void editor_insert_char(int c)
 {
+	erow *row;
+	char ch = c;
 	if(e.cy == e.num_rows) {
+		editor_record(UNDO_ROW_INSERT, e.num_rows, 0, "", 0);
 		editor_insert_row(e.num_rows, "", 0);
 	}
-	editor_row_insert_char(&e.row[e.cy], e.cx, c);
+	row = editor_row(e.cy);
+	/* cursor can be past the end after rows were swapped under it */
+	if(e.cx > row->size) e.cx = row->size;
+	undo_typed(&e.undo, e.cy, e.cx, &ch, 1);
+	journal_add(&e.journal, UNDO_INSERT, e.cy, e.cx, &ch, 1);
+	editor_row_insert_char(row, e.cx, c);
+	editor_syntax_changed(e.cy);
 	e.cx++;
 }
 /* Insert a new line.
  */
 void editor_insert_line()
 {
-	if(e.cx == 0) {
+	if(e.cy < e.num_rows && e.cx > editor_row(e.cy)->size)
+		e.cx = editor_row(e.cy)->size;
+	if(e.cy == e.num_rows) {
+		editor_record(UNDO_ROW_INSERT, e.cy, 0, "", 0);
 		editor_insert_row(e.cy, "", 0);
 	} else {
-		erow *row = &e.row[e.cy];
-		editor_insert_row(e.cy+1, &row->data[e.cx], row->size-e.cx);
-		row = &e.row[e.cy];
-		row->size = e.cx;
-		row->data[row->size] = '\0';
-		editor_update_row(row);
+		editor_record(UNDO_SPLIT, e.cy, e.cx, NULL, 0);
+		editor_split_row(e.cy, e.cx);
 	}
 	e.cy++;
 	e.cx = 0;
 }
+/* Insert text spanning any number of lines at the cursor as one splice,
+ * lexing once for all of it.
+ */
+void editor_insert_text(const char *s, size_t len)
+{
+	const char *end = s+len, *nl, *last = NULL;
+	erow *row;
+	int first, k;
+	if(len == 0) return;
+	if(e.cy == e.num_rows) {
+		editor_record(UNDO_ROW_INSERT, e.cy, 0, "", 0);
+		editor_insert_row(e.cy, "", 0);
+	}
+	row = editor_row(e.cy);
+	if(e.cx > row->size) e.cx = row->size;
+	first = e.cy;
+	nl = memchr(s, '\n', len);
+	if(nl != NULL) {
+		editor_record(UNDO_SPLIT, e.cy, e.cx, NULL, 0);
+		editor_split_row(e.cy, e.cx);
+		row = editor_row(e.cy);
+		editor_record(UNDO_INSERT, e.cy, e.cx, s, nl-s);
+		editor_row_insert_text(row, e.cx, s, nl-s);
+		/* whole lines go in between the two halves */
+		for(s = nl+1, k = 0, nl = s; nl < end; nl++)
+			if(*nl == '\n') {
+				last = nl;
+				k++;
+			}
+		if(k > 0) {
+			editor_record(UNDO_ROWS_INSERT, e.cy+1, k, s, last+1-s);
+			editor_insert_joined(e.cy+1, s, last+1-s, k);
+			e.cy += k;
+			s = last+1;
+		}
+		e.cy++;
+		e.cx = 0;
+		row = editor_row(e.cy);
+	}
+	if(s < end) {
+		editor_record(UNDO_INSERT, e.cy, e.cx, s, end-s);
+		editor_row_insert_text(row, e.cx, s, end-s);
+		e.cx += end-s;
+	}
+	editor_syntax_changed(first);
+}
 /* Delete character from row at index.
  */
 void editor_delete_char()
 {
 	if(e.cy == e.num_rows) return;
 	if(e.cx == 0 && e.cy == 0) return;
-	erow *row = &e.row[e.cy];
+	erow *row = editor_row(e.cy);
+	if(e.cx > row->size) e.cx = row->size;
 	if(e.cx > 0) {
+		editor_record(UNDO_DELETE, e.cy, e.cx-1,
+			editor_row_span(row, e.cx-1, 1), 1);
 		editor_row_delete_char(row, e.cx-1);
+		editor_syntax_changed(e.cy);
 		e.cx--;
 	} else {
-		e.cx = e.row[e.cy-1].size;
-		editor_row_append_string(&e.row[e.cy-1], row->data, row->size);
-		editor_delete_row(e.cy);
+		e.cx = editor_row(e.cy-1)->size;
+		editor_record(UNDO_JOIN, e.cy-1, e.cx, NULL, 0);
+		editor_join_row(e.cy-1);
 		e.cy--;
 	}
 }
+/* Apply edit to the document, leaving the cursor where it happened.
+ */
+void editor_apply(int op, int row, int col, const char *s, size_t len)
+{
+	e.cy = row;
+	e.cx = col;
+	switch(op) {
+	case UNDO_INSERT:
+		editor_row_insert_text(editor_row(row), col, s, len);
+		editor_syntax_changed(row);
+		e.cx += len;
+	break;
+	case UNDO_DELETE:
+		editor_row_delete_text(editor_row(row), col, len);
+		editor_syntax_changed(row);
+	break;
+	case UNDO_SPLIT:
+		editor_split_row(row, col);
+		e.cy++;
+		e.cx = 0;
+	break;
+	case UNDO_JOIN:
+		editor_join_row(row);
+	break;
+	case UNDO_ROW_INSERT:
+		editor_insert_row(row, s, len);
+	break;
+	case UNDO_ROW_DELETE:
+		editor_delete_row(row);
+	break;
+	case UNDO_ROWS_INSERT:
+		editor_insert_joined(row, s, len, col);
+		e.cx = 0;
+	break;
+	case UNDO_ROWS_DELETE:
+		editor_delete_rows(row, col);
+		e.cx = 0;
+	break;
+	}
+}
+/* Apply journal record, or its inverse when taking it back.
+ */
+void editor_undo_apply(const undo_rec *r, int back)
+{
+	static const int inverse[] = {
+		UNDO_DELETE, UNDO_INSERT, UNDO_JOIN, UNDO_SPLIT,
+		UNDO_ROW_DELETE, UNDO_ROW_INSERT,
+		UNDO_ROWS_DELETE, UNDO_ROWS_INSERT
+	};
+	int op = back ? inverse[r->op] : r->op;
+	const char *s = undo_bytes(&e.undo, r);
+	editor_apply(op, r->row, r->col, s, r->len);
+	journal_add(&e.journal, op, r->row, r->col, s, r->len);
+}
+/* Take back the last step of edits, or redo the last one taken back.
+ */
+void editor_undo(int redo)
+{
+	const undo_rec *r;
+	int more = 0;
+	while((r = redo ? undo_forward(&e.undo, more) :
+	    undo_back(&e.undo, more)) != NULL) {
+		editor_undo_apply(r, !redo);
+		more = 1;
+	}
+	if(!more)
+		editor_set_status(redo ? "Nothing to redo." : "Nothing to undo.");
+}
+/* Draw rendered run of row, return column after it.
+ */
+int editor_draw_span(int y, int x, const char *c, const unsigned char *hl,
+	int len)
+{
+	int i = 0;
+	/* copy runs of the same highlight in one go */
+	while(i < len) {
+		int run = i+1;
+		while(run < len && hl[run] == hl[i]) run++;
+		screen_text(y, x+i, &c[i], run-i, editor_syntax_to_color(hl[i]), 0);
+		i = run;
+	}
+	return x+len;
+}
+/* Copy highlight of row 'at' between render columns 'from' and 'to'
+ * with the search matches in it marked, NULL if it holds none.
+ */
+const unsigned char *editor_search_marks(int at, erow *row, int from, int to)
+{
+	int editor_row_cx_to_rx(erow *row, int cx);
+	static unsigned char *mark = NULL;
+	static int mark_cap = 0;
+	esearch *se = &e.search;
+	size_t i;
+	int k;
+	if(!se->active || se->n == 0) return NULL;
+	i = editor_search_lookup(se, at, 0);
+	if(i == se->n || se->m[i].row != at) return NULL;
+	if(to-from > mark_cap) {
+		mark_cap = to-from;
+		mark = realloc(mark, mark_cap);
+	}
+	if(row->render != NULL) {
+		memcpy(mark, &row->hl[from], to-from);
+	} else {
+		for(k = from; k < to; k++)
+			mark[k-from] = row->hl[ROW_AT(row, k)];
+	}
+	for(; i < se->n && se->m[i].row == at; i++) {
+		int rx = editor_row_cx_to_rx(row, se->m[i].col);
+		int end = editor_row_cx_to_rx(row, se->m[i].col+se->m[i].mlen);
+		if(rx < from) rx = from;
+		if(end > to) end = to;
+		if(rx < end) memset(&mark[rx-from], HL_MATCH, end-rx);
+	}
+	return mark;
+}
 /* Draw rows for editor.
  */
-void editor_draw_rows(struct abuf *ab)
+void editor_draw_rows(void)
 {
 	int y;
 	for(y = 0; y < e.screen_rows; y++) {
 		int file_row = y+e.row_off;
+		int x = 0;
 		if(file_row >= e.num_rows) {
+			x = screen_text(y, 0, "~", 1, PRSED_EDITOR_COLOR, 0);
 			if(e.num_rows == 0 && y == e.screen_rows/3) {
 				char welcome[80];
 				int welcome_len;
@@ -613,51 +2237,38 @@ void editor_draw_rows(struct abuf *ab)
 				if(welcome_len > e.screen_cols)
 					welcome_len = e.screen_cols;
 				padding = (e.screen_cols-welcome_len)/2;
-				if(padding != 0) {
-					ab_append(ab, "~", 1);
-					padding--;
-				}
-				while(padding-- != 0) ab_append(ab, " ", 1);
-				ab_append(ab, welcome, welcome_len);
-			} else {
-				ab_append(ab, "~", 1);
+				screen_fill(y, x, ' ', PRSED_EDITOR_COLOR, 0);
+				x = screen_text(y, padding, welcome, welcome_len,
+					PRSED_EDITOR_COLOR, 0);
 			}
 		} else {
-			unsigned char *hl = NULL;
-			char *c = NULL;
-			int i, len, cur_col;
-
-			len = e.row[file_row].rsize-e.col_off;
-			if(len < 0) len = 0;
-			if(len > e.screen_cols) len = e.screen_cols;
-			c = &e.row[file_row].render[e.col_off];
-			hl = &e.row[file_row].hl[e.col_off];
-			cur_col = -1;
-			for(i = 0; i < len; i++) {
-				if(hl[i] == HL_NORMAL) {
-					if(cur_col != -1) {
-						ab_append(ab, PRSED_COLOR, strlen(PRSED_COLOR));
-						cur_col = -1;
-					}
-					ab_append(ab, &c[i], 1);
-				} else {
-					int color = editor_syntax_to_color(hl[i]);
-					if(color != cur_col) {
-						char buf[16];
-						int clen;
-						cur_col = color;
-						memset(buf, 0, sizeof(buf));
-						clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-						ab_append(ab, buf, clen);
-					}
-					ab_append(ab, &c[i], 1);
-				}
+			erow *row = editor_render_row(file_row);
+			const unsigned char *mark = NULL;
+			int from = e.col_off, to = e.col_off+e.screen_cols;
+			if(to > row->rsize) to = row->rsize;
+			if(from < to)
+				mark = editor_search_marks(file_row, row, from, to);
+			if(row->render != NULL) {
+				if(from < to)
+					x = editor_draw_span(y, x, &row->render[from],
+						mark ? mark : &row->hl[from], to-from);
+			} else {
+				/* text and highlight may be split by the edit gap */
+				int split = row->gap, skip = row->cap-row->size;
+				int start = from;
+				if(from < split && from < to)
+					x = editor_draw_span(y, x, &row->data[from],
+						mark ? mark : &row->hl[from],
+						(to < split ? to : split)-from);
+				if(from < split) from = split;
+				if(from < to)
+					x = editor_draw_span(y, x,
+						&row->data[from+skip],
+						mark ? &mark[from-start] :
+						&row->hl[from+skip], to-from);
 			}
-			ab_append(ab, PRSED_COLOR, strlen(PRSED_COLOR));
 		}
-
-		ab_append(ab, "\x1b[K", 3);
-		ab_append(ab, "\r\n", 2);
+		screen_fill(y, x, ' ', PRSED_EDITOR_COLOR, 0);
 	}
 }
 /* Calculate render index from character index.
@@ -665,8 +2276,9 @@ void editor_draw_rows(struct abuf *ab)
 int editor_row_cx_to_rx(erow *row, int cx)
 {
 	int i, rx = 0;
+	if(row->tabs == 0) return cx;
 	for(i = 0; i < cx; i++) {
-		if(row->data[i] == '\t') {
+		if(row->data[ROW_AT(row, i)] == '\t') {
 			rx += (PRSED_TAB_STOP - 1)-(rx % PRSED_TAB_STOP);
 		}
 		rx++;
@@ -678,8 +2290,9 @@ int editor_row_cx_to_rx(erow *row, int cx)
 int editor_row_rx_to_cx(erow *row, int rx)
 {
 	int cx, cur_rx = 0;
+	if(row->tabs == 0) return rx < row->size ? rx : row->size;
 	for(cx = 0; cx < row->size; cx++) {
-		if(row->data[cx] == '\t') {
+		if(row->data[ROW_AT(row, cx)] == '\t') {
 			cur_rx += (PRSED_TAB_STOP - 1)-(cur_rx % PRSED_TAB_STOP);
 		}
 		cur_rx++;
@@ -694,7 +2307,7 @@ void editor_scroll()
 	/* Handle tab stops */
 	e.rx = 0;
 	if(e.cy < e.num_rows) {
-		e.rx = editor_row_cx_to_rx(&e.row[e.cy], e.cx);
+		e.rx = editor_row_cx_to_rx(editor_row(e.cy), e.cx);
 	}
 	/* vertical scrolling */
 	if(e.cy < e.row_off) {
@@ -713,64 +2326,94 @@ void editor_scroll()
 }
 /* Draw a status bar at the bottom of the screen.
  */
-void editor_draw_status(struct abuf *ab)
+void editor_draw_status(void)
 {
 	char status[80], rstatus[80];
-	int len = 0, rlen = 0;
-	ab_append(ab, "\x1b[7m", 4);
+	int len = 0, rlen = 0, y = e.screen_rows;
 	len = snprintf(status, sizeof(status), "[%.20s]%s - %d lines",
 	  e.filename ? e.filename : "No Name",
 	  e.dirty ? " (modified)" : "", e.num_rows);
-	rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d", e.cy+1, e.num_rows);
-	if(len > e.screen_cols) len = e.screen_cols;
-	ab_append(ab, status, len);
-	while(len < e.screen_cols) {
-		if(e.screen_cols-len == rlen) {
-			ab_append(ab, rstatus, rlen);
-			break;
-		} else {
-			ab_append(ab, " ", 1);
-			len++;
-		}
+	if(e.save.active)
+		len += snprintf(status+len, sizeof(status)-len, " - saving %d%%",
+		  e.save.pct);
+	e.save.shown = e.save.pct;
+	if(e.search.active && e.search.error != NULL)
+		len += snprintf(status+len, sizeof(status)-len, " - %s",
+		  e.search.error);
+	else if(e.search.active && e.search.qlen > 0)
+		len += snprintf(status+len, sizeof(status)-len, " - %lu of %lu",
+		  (unsigned long)(e.search.total ? e.search.cur+1 : 0),
+		  (unsigned long)e.search.total);
+	if(len >= (int)sizeof(status)) len = sizeof(status)-1;
+	if(e.show_stats) {
+		struct screen_stats st;
+		struct slab_stats sl;
+		screen_get_stats(&st);
+		slab_get_stats(&e.slab, &sl);
+		rlen = snprintf(rstatus, sizeof(rstatus),
+		  "%luB %luK/%luK %s | %d/%d",
+		  (unsigned long)st.last, (unsigned long)(sl.used/1024),
+		  (unsigned long)(sl.wasted/1024), e.syntax->def->name,
+		  e.cy+1, e.num_rows);
+	} else {
+		rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d",
+		  e.syntax->def->name, e.cy+1, e.num_rows);
 	}
-	ab_append(ab, "\x1b[m", 3);
-	ab_append(ab, "\r\n", 2);
+	if(len > e.screen_cols) len = e.screen_cols;
+	screen_text(y, 0, status, len, PRSED_EDITOR_COLOR, SCREEN_REVERSE);
+	screen_fill(y, len, ' ', PRSED_EDITOR_COLOR, SCREEN_REVERSE);
+	if(len+rlen <= e.screen_cols)
+		screen_text(y, e.screen_cols-rlen, rstatus, rlen,
+			PRSED_EDITOR_COLOR, SCREEN_REVERSE);
 }
 /* Draws the message bar on the screen.
  */
-void editor_draw_message(struct abuf *ab)
+void editor_draw_message(void)
 {
-	int len = strlen(e.status);
-	ab_append(ab, PRSED_COLOR, strlen(PRSED_COLOR));
-	ab_append(ab, "\x1b[K", 3);
+	int len = strlen(e.status), y = e.screen_rows+1;
 	if(len > e.screen_cols) len = e.screen_cols;
-	if(len > 0 && time(NULL)-e.status_time < 5) {
-		ab_append(ab, e.status, len);
-		while(len < e.screen_cols) {
-			ab_append(ab, " ", 1);
-			len++;
-		}
-	}
+	if(len > 0 && (e.prompting ||
+	    time(NULL)-e.status_time < PRSED_STATUS_TIME))
+		screen_text(y, 0, e.status, len, PRSED_EDITOR_COLOR, 0);
+	else
+		len = 0;
+	screen_fill(y, len, ' ', PRSED_EDITOR_COLOR, 0);
 }
 /* Clear the screen.
  */
 void editor_refresh_screen()
 {
-	struct abuf ab = ABUF_INIT;
-	char buf[32];
+	static int last_row_off = -1;
+	static int last_col_off = -1;
+	int delta;
 	editor_scroll();
-	ab_append(&ab, PRSED_COLOR, strlen(PRSED_COLOR));
-	ab_append(&ab, "\x1b[?25l", 6);
-	ab_append(&ab, "\x1b[H", 3);
-	editor_draw_rows(&ab);
-	editor_draw_status(&ab);
-	editor_draw_message(&ab);
-	snprintf(buf, sizeof(buf), "\x1b[%d;%dH",
-			(e.cy-e.row_off)+1, (e.rx-e.col_off)+1);
-	ab_append(&ab, buf, strlen(buf));
-	ab_append(&ab, "\x1b[?25h", 6);
-	write(STDOUT_FILENO, ab.b, ab.len);
-	ab_free(&ab);
+	/* a few lines of vertical scroll can reuse what is on screen */
+	delta = e.row_off-last_row_off;
+	if(last_row_off >= 0 && e.col_off == last_col_off && delta != 0 &&
+	    delta < e.screen_rows/2 && -delta < e.screen_rows/2)
+		screen_scroll(0, e.screen_rows, delta);
+	last_row_off = e.row_off;
+	last_col_off = e.col_off;
+	editor_draw_rows();
+	editor_trim_render();
+	editor_draw_status();
+	editor_draw_message();
+	screen_flush(e.cy-e.row_off, e.rx-e.col_off);
+	worker_kick();
+}
+/* Draw a frame, unless more input waits and the last frame is too
+ * recent. Keys that keep coming are all handled while frames go out at
+ * the frame rate, the frame after the last key is drawn at once.
+ */
+void editor_schedule_refresh(void)
+{
+	struct timespec ts;
+	double now;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = ts.tv_sec+ts.tv_nsec/1e9;
+	if(event_pending() && now-e.frame_time < 1.0/e.fps) return;
+	editor_refresh_screen();
+	e.frame_time = now;
 }
 /* Draw a status bar to display common hot keys.
  */
@@ -782,34 +2425,75 @@ void editor_set_status(const char *fmt, ...)
 	va_end(ap);
 	e.status_time = time(NULL);
 }
+/* Fit screen to the new window size.
+ */
+void editor_resize(void)
+{
+	int rows, cols;
+	if(get_window_size(&rows, &cols) < 0 || rows < 3 || cols < 1)
+		return;
+	screen_resize(rows, cols);
+	e.screen_rows = rows-2;
+	e.screen_cols = cols;
+}
+/* Milliseconds until the next timer runs out, -1 when none is set.
+ */
+int editor_next_timer(void)
+{
+	int next = journal_next(&e.journal);
+	if(e.status[0] != '\0' && !e.prompting) {
+		struct timespec ts;
+		long left;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		left = (long)(e.status_time+PRSED_STATUS_TIME-ts.tv_sec)*1000-
+			ts.tv_nsec/1000000;
+		if(left > 0 && (next < 0 || left < next)) next = left;
+	}
+	return next;
+}
 /* Read input from user.
  */
 int editor_read_key()
 {
-	int nread;
-	char c;
-	while((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-		if(nread < 0 && errno != EAGAIN) die("read");
+	int c, ev;
+	for(;;) {
+		int timeout = editor_next_timer();
+		/* background work only runs while waiting for keys */
+		worker_unlock();
+		ev = event_wait(timeout);
+		worker_lock();
+		if(ev < 0) die("read");
+		if(ev & EVENT_INPUT) break;
+		if(ev & EVENT_RESIZE) editor_resize();
+		if(journal_due(&e.journal)) worker_kick();
+		/* a timer ran out, the window changed or a save moved on */
+		if(ev != EVENT_WAKE || e.save.pct != e.save.shown)
+			editor_refresh_screen();
 	}
+	c = event_getc(0);
 	if(c == '\x1b') {
-		char seq[3];
+		int seq[3];
 
-		if(read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-		if(read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
+		if((seq[0] = event_getc(PRSED_KEY_WAIT)) < 0) return '\x1b';
+		if((seq[1] = event_getc(PRSED_KEY_WAIT)) < 0) return '\x1b';
 
 		if(seq[0] == '[') {
 			if(seq[1] >= '0' && seq[1] <= '9') {
-				if(read(STDIN_FILENO, &seq[2], 1) != 1)
-					return '\x1b';
+				int n = seq[1]-'0';
+				while((seq[2] = event_getc(PRSED_KEY_WAIT)) >= '0' &&
+				    seq[2] <= '9' && n < 1000)
+					n = n*10+seq[2]-'0';
+				if(seq[2] < 0) return '\x1b';
 				if(seq[2] == '~') {
-					switch(seq[1]) {
-					case '1': return HOME_KEY;
-					case '3': return DEL_KEY;
-					case '4': return END_KEY;
-					case '5': return PAGE_UP;
-					case '6': return PAGE_DOWN;
-					case '7': return HOME_KEY;
-					case '8': return END_KEY;
+					switch(n) {
+					case 1: return HOME_KEY;
+					case 3: return DEL_KEY;
+					case 4: return END_KEY;
+					case 5: return PAGE_UP;
+					case 6: return PAGE_DOWN;
+					case 7: return HOME_KEY;
+					case 8: return END_KEY;
+					case 200: return PASTE_START;
 					default: break;
 					}
 				}
@@ -836,6 +2520,33 @@ int editor_read_key()
 		return c;
 	}
 }
+/* Read bracketed paste after PASTE_START into the paste buffer, line
+ * ends become '\n'. Returns length of pasted text.
+ */
+size_t editor_read_paste(void)
+{
+	static const char end[] = "\x1b[201~";
+	size_t len = 0;
+	int c, cr = 0;
+	while((c = event_getc(PRSED_PASTE_WAIT)) >= 0) {
+		if(len+1 > e.paste_cap) {
+			e.paste_cap = e.paste_cap > 0 ? e.paste_cap*2 : 4096;
+			e.paste = realloc(e.paste, e.paste_cap);
+		}
+		/* terminals send '\r' for a new line */
+		if(c == '\n' && cr) {
+			cr = 0;
+			continue;
+		}
+		cr = c == '\r';
+		e.paste[len++] = cr ? '\n' : c;
+		if(c == '~' && len >= sizeof(end)-1 &&
+		    memcmp(&e.paste[len-sizeof(end)+1], end, sizeof(end)-1) == 0)
+			return len-sizeof(end)+1;
+	}
+	/* the end mark never came, keep what did */
+	return len;
+}
 /* Prompt user for input.
  */
 char *editor_prompt(const char *msg, void (*callback)(const char *, int))
@@ -844,23 +2555,36 @@ char *editor_prompt(const char *msg, void (*callback)(const char *, int))
 	static char buf[MAXBUF];
 	size_t i = 0;
 	int c;
+	/* the prompt stays on screen however long it waits */
+	e.prompting = 1;
 	do {
 		editor_set_status(msg, buf);
-		editor_refresh_screen();
+		editor_schedule_refresh();
 
 		c = editor_read_key();
 		if(c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
 			if(i != 0) buf[--i] = '\0';
 		} else if(c == '\x1b') {
+			e.prompting = 0;
 			editor_set_status("", 0);
 			if(callback != NULL) callback(buf, c);
 			return NULL;
 		} else if(c == '\r') {
 			if(i != 0) {
+				e.prompting = 0;
 				editor_set_status("", 0);
 				if(callback != NULL) callback(buf, c);
 				return &buf[0];
 			}
+		} else if(c == PASTE_START) {
+			size_t j, len = editor_read_paste();
+			for(j = 0; j < len && i < MAXBUF-1; j++) {
+				if(iscntrl((unsigned char)e.paste[j]) ||
+				    (unsigned char)e.paste[j] >= 128)
+					continue;
+				buf[i++] = e.paste[j];
+			}
+			buf[i] = '\0';
 		} else if(!iscntrl(c) && c < 128) {
 			if(i < MAXBUF-1) {
 				buf[i++] = c;
@@ -870,6 +2594,7 @@ char *editor_prompt(const char *msg, void (*callback)(const char *, int))
 
 		if(callback != NULL) callback(buf, c);
 	} while(i < MAXBUF-1);
+	e.prompting = 0;
 	return &buf[0];
 #undef MAXBUF
 }
@@ -877,7 +2602,7 @@ char *editor_prompt(const char *msg, void (*callback)(const char *, int))
  */
 void editor_move_cursor(int key)
 {
-	erow *row = (e.cy >= e.num_rows) ? NULL : &e.row[e.cy];
+	erow *row = (e.cy >= e.num_rows) ? NULL : editor_row(e.cy);
 	int row_len;
 
 	switch(key) {
@@ -886,7 +2611,7 @@ void editor_move_cursor(int key)
 			e.cx--;
 		} else if(e.cy > 0) {
 			e.cy--;
-			e.cx = e.row[e.cy].size;
+			e.cx = editor_row(e.cy)->size;
 		}
 	break;
 	case ARROW_RIGHT:
@@ -911,7 +2636,7 @@ void editor_move_cursor(int key)
 	break;
 	}
 
-	row = (e.cy >= e.num_rows) ? NULL : &e.row[e.cy];
+	row = (e.cy >= e.num_rows) ? NULL : editor_row(e.cy);
 	row_len = row ? row->size : 0;
 	if(e.cx > row_len) {
 		e.cx = row_len;
@@ -924,6 +2649,7 @@ void editor_process_key() {
 	int c = editor_read_key();
 	void reset_editor(void);
 
+	undo_step(&e.undo);
 	switch(c) {
 	case CTRL_KEY('w'):
 	break;
@@ -939,10 +2665,11 @@ void editor_process_key() {
 			return;
 		}
 		disable_raw();
+		editor_journal_drop();
 		editor_free();
-		write(STDOUT_FILENO, "\x1b[m", 3);
-		write(STDOUT_FILENO, "\x1b[2J", 4);
-		write(STDOUT_FILENO, "\x1b[H", 3);
+		editor_write("\x1b[m", 3);
+		editor_write("\x1b[2J", 4);
+		editor_write("\x1b[H", 3);
 		exit(0);
 	break;
 	case CTRL_KEY('s'):
@@ -959,12 +2686,18 @@ void editor_process_key() {
 			editor_paste_copy();
 	break;
 	case CTRL_KEY('u'):
-		if(e.cy >= 0 && e.cy <= e.num_rows)
-			editor_undo_copy();
+		editor_undo(0);
+	break;
+	case CTRL_KEY('y'):
+		editor_undo(1);
 	break;
 	case CTRL_KEY('k'):
 		if(e.cy >= 0 && e.cy < e.num_rows) {
-			editor_insert_copy(e.num_copy, e.row[e.cy].data, e.row[e.cy].size);
+			erow *row = editor_row(e.cy);
+			editor_row_flat(row);
+			editor_insert_copy(e.num_copy, row->data, row->size);
+			editor_record(UNDO_ROW_DELETE, e.cy, 0,
+				row->data, row->size);
 			editor_delete_row(e.cy);
 		}
 	break;
@@ -982,7 +2715,7 @@ void editor_process_key() {
 	break;
 	case END_KEY:
 		if(e.cy < e.num_rows)
-			e.cx = e.row[e.cy].size;
+			e.cx = editor_row(e.cy)->size;
 	break;
 	case BACKSPACE:
 	case CTRL_KEY('h'):
@@ -1011,6 +2744,9 @@ void editor_process_key() {
 	case ARROW_RIGHT:
 		editor_move_cursor(c);
 	break;
+	case PASTE_START:
+		editor_insert_text(e.paste, editor_read_paste());
+	break;
 	case CTRL_KEY('l'):
 	case '\x1b':
 	break;
@@ -1033,21 +2769,48 @@ void init_editor()
 	e.col_off = 0;
 	e.num_rows = 0;
 	e.num_copy = 0;
-	e.row = NULL;
+	e.copy_cap = 0;
+	slab_init(&e.slab);
+	slab_init(&e.copy_slab);
+	rows_init(&e.rows, &e.slab);
+	e.open_row = NULL;
+	e.render_bytes = 0;
+	e.syntax = syntax_find(NULL, NULL, 0);
+	e.hl_stale_from = INT_MAX;
+	e.hl_gen = 0;
+	e.map = NULL;
+	e.map_len = 0;
+	e.map_fd = -1;
 	e.copy = NULL;
+	e.paste = NULL;
+	e.paste_cap = 0;
+	undo_init(&e.undo, PRSED_UNDO_MAX);
+	journal_init(&e.journal);
+	memset(&e.save, 0, sizeof(esave));
+	e.save.pct = -1;
+	e.save.shown = -1;
 	e.dirty = 0;
 	e.filename = NULL;
 	e.status[0] = '\0';
 	e.status_time = 0;
+	e.prompting = 0;
+
+	e.show_stats = getenv("PRSED_STATS") != NULL;
+	e.fps = getenv("PRSED_FPS") != NULL ? atoi(getenv("PRSED_FPS")) : 0;
+	if(e.fps <= 0) e.fps = PRSED_FPS;
+	e.frame_time = 0;
 
 	if(get_window_size(&e.screen_rows, &e.screen_cols) < 0)
 		die("get_window_size");
+	screen_resize(e.screen_rows, e.screen_cols);
 	e.screen_rows -= 2;
+	worker_start(editor_work, NULL);
 }
 /* Reset editor free all data and re-initialize.
  */
 void reset_editor()
 {
+	editor_journal_drop();
 	editor_free();
 	init_editor();
 }
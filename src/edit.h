@@ -9,15 +9,30 @@
 #ifndef EDIT_H
 #define EDIT_H
 
+#include <stddef.h>
+
+/* Input and output backend the editor can run on instead of a terminal */
+typedef struct editor_io {
+	int in;					/* descriptor keys are read from */
+	void (*out)(const char *s, size_t len);	/* takes what is drawn */
+	int rows, cols;				/* window size */
+} editor_io;
+
 /* Enable raw mode in terminal */
 void enable_raw();
+/* Run editor on backend instead of the terminal, in place of enable_raw() */
+void editor_use_io(const editor_io *io);
 /* Initialise editor */
 void init_editor();
+/* Throw document away and start over with an empty one. */
+void reset_editor();
 
 /* Open file for reading/writing. */
 void editor_open(const char *filename);
 /* Refresh screen for editor. */
 void editor_refresh_screen();
+/* Refresh screen unless input waits and the frame rate allows no frame. */
+void editor_schedule_refresh(void);
 /* Set status message. */
 void editor_set_status(const char *fmt, ...);
 /* Prompt user for input. */
@@ -0,0 +1,150 @@
+/**
+ * @file event.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Poll based terminal input and wake up events for PRS Edit.
+ *
+ * The editor sleeps in poll() on the terminal and on a self-pipe, so an
+ * idle editor uses no CPU at all. Input is read in batches into a buffer
+ * and keys are parsed from there, a whole escape sequence or a burst of
+ * typing costs one read. Window size changes (SIGWINCH) and the worker
+ * wake the loop by writing a byte into the pipe naming the event.
+ ************************************************************************
+ */
+
+#if defined(__FreeBSD__) || defined(__OpenBSD__)
+#define _BSD_SOURCE
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "event.h"
+
+/* Input buffer and self-pipe */
+static struct {
+	int fd;
+	int pipe[2];
+	int flags;
+	char buf[EVENT_BUF];
+	int at, len;
+} ev = { -1, { -1, -1 }, 0, { 0 }, 0, 0 };
+
+/* Tell the loop what happened through the pipe.
+ */
+static void event_post(char c)
+{
+	int saved = errno;
+	if(ev.pipe[1] >= 0) write(ev.pipe[1], &c, 1);
+	errno = saved;
+}
+/* Window size changed.
+ */
+static void event_winch(int sig)
+{
+	event_post('r');
+}
+/* Make descriptor non blocking and keep it from child processes.
+ */
+static int event_nonblock(int fd)
+{
+	int fl = fcntl(fd, F_GETFL);
+	if(fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) return -1;
+	return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+/* Read input from 'fd' and catch window size changes.
+ */
+int event_init(int fd)
+{
+	struct sigaction sa;
+	if(ev.pipe[0] < 0) {
+		if(pipe(ev.pipe) < 0) return -1;
+		if(event_nonblock(ev.pipe[0]) < 0 ||
+		    event_nonblock(ev.pipe[1]) < 0)
+			return -1;
+	}
+	ev.fd = fd;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = event_winch;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	return sigaction(SIGWINCH, &sa, NULL);
+}
+/* Empty the pipe, remembering the events it held.
+ */
+static void event_drain(void)
+{
+	char buf[64];
+	ssize_t i, n;
+	while((n = read(ev.pipe[0], buf, sizeof(buf))) > 0) {
+		for(i = 0; i < n; i++)
+			ev.flags |= (buf[i] == 'r') ? EVENT_RESIZE : EVENT_WAKE;
+	}
+}
+/* Sleep until input or an event comes, fill the buffer when the input
+ * is empty. Returns the number of ready descriptors, zero on timeout.
+ */
+static int event_poll(int timeout)
+{
+	struct pollfd p[2];
+	ssize_t n;
+	int ready;
+	p[0].fd = ev.fd;
+	p[0].events = POLLIN;
+	p[1].fd = ev.pipe[0];
+	p[1].events = POLLIN;
+	ready = poll(p, 2, timeout);
+	if(ready < 0) return errno == EINTR ? 1 : -1;
+	if(p[1].revents & POLLIN) event_drain();
+	if(p[0].revents == 0 || ev.at < ev.len) return ready;
+	do {
+		n = read(ev.fd, ev.buf, EVENT_BUF);
+	} while(n < 0 && errno == EINTR);
+	if(n < 0 && errno == EAGAIN) return ready;
+	/* ready but nothing to read, the terminal hung up */
+	if(n <= 0) return -1;
+	ev.at = 0;
+	ev.len = n;
+	return ready;
+}
+/* Wait for input and events.
+ */
+int event_wait(int timeout)
+{
+	int flags;
+	if(ev.at == ev.len && ev.flags == 0 && event_poll(timeout) < 0)
+		return -1;
+	flags = ev.flags;
+	if(ev.at < ev.len) flags |= EVENT_INPUT;
+	ev.flags = 0;
+	return flags;
+}
+/* Take next input byte.
+ */
+int event_getc(int timeout)
+{
+	while(ev.at == ev.len) {
+		/* events that come in the meantime wait for event_wait() */
+		if(event_poll(timeout) <= 0) return -1;
+	}
+	return (unsigned char)ev.buf[ev.at++];
+}
+/* Check for input without waiting.
+ */
+int event_pending(void)
+{
+	if(ev.at == ev.len) event_poll(0);
+	return ev.at < ev.len;
+}
+/* Wake event_wait().
+ */
+void event_wake(void)
+{
+	event_post('w');
+}
@@ -0,0 +1,33 @@
+/**
+ * @file event.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Poll based terminal input and wake up events.
+ ********************************************************************
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+/* Events returned by event_wait() */
+#define EVENT_INPUT 1	/* input bytes wait in the buffer */
+#define EVENT_RESIZE 2	/* terminal window changed size */
+#define EVENT_WAKE 4	/* event_wake() was called */
+
+/* Bytes of input read at once */
+#define EVENT_BUF 4096
+
+/* Read input from 'fd' and catch window size changes, returns -1 on error. */
+int event_init(int fd);
+/* Wait up to 'timeout' milliseconds (forever if negative), returns events
+ * that happened (zero on timeout) or -1 when input failed. */
+int event_wait(int timeout);
+/* Take next input byte, waiting up to 'timeout' milliseconds for one,
+ * returns -1 when none came. */
+int event_getc(int timeout);
+/* Check for input without waiting, reading what already arrived. */
+int event_pending(void);
+/* Wake event_wait(), safe from any thread and from signal handlers. */
+void event_wake(void);
+
+#endif
@@ -0,0 +1,334 @@
+/**
+ * @file journal.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Append only crash recovery journal for PRS Edit.
+ *
+ * Edits are appended to a memory buffer as small binary records (the
+ * same operations the undo history keeps) and the worker writes them out
+ * as a group every JOURNAL_FLUSH_MS, so typing never waits for the disk.
+ * The file starts with a base record naming the file on disk it applies
+ * to. A save appends a snapshot record when it starts and, once the file
+ * is replaced, a base record for the new file, so a journal replays from
+ * the snapshot the file on disk holds. A journal whose last base does
+ * not match the file is stale and starts over.
+ ************************************************************************
+ */
+
+#if defined(__FreeBSD__) || defined(__OpenBSD__)
+#define _BSD_SOURCE
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+/* Start of every journal file */
+#define JOURNAL_MAGIC "PRSEDJ1\n"
+#define JOURNAL_MAGIC_LEN 8
+/* Bytes of record header: operation, row, column, length */
+#define JOURNAL_REC 13
+
+/* Decoded journal record */
+struct jrec {
+	int op;
+	int row, col;
+	size_t len;
+	const char *s;
+	size_t next;
+};
+
+/* Current time in seconds.
+ */
+static double journal_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+/* Store 32 bit number little endian.
+ */
+static void put32(char *p, unsigned long v)
+{
+	p[0] = v&0xff;
+	p[1] = (v>>8)&0xff;
+	p[2] = (v>>16)&0xff;
+	p[3] = (v>>24)&0xff;
+}
+/* Load 32 bit little endian number.
+ */
+static unsigned long get32(const char *p)
+{
+	const unsigned char *u = (const unsigned char*)p;
+	return u[0]|(u[1]<<8)|((unsigned long)u[2]<<16)|
+		((unsigned long)u[3]<<24);
+}
+/* Decode record at 'pos', returns zero when it is cut short.
+ */
+static int journal_parse(const char *buf, size_t len, size_t pos,
+	struct jrec *r)
+{
+	if(len-pos < JOURNAL_REC) return 0;
+	r->op = (unsigned char)buf[pos];
+	r->row = (int)get32(buf+pos+1);
+	r->col = (int)get32(buf+pos+5);
+	r->len = get32(buf+pos+9);
+	if(len-pos-JOURNAL_REC < r->len) return 0;
+	r->s = buf+pos+JOURNAL_REC;
+	r->next = pos+JOURNAL_REC+r->len;
+	return 1;
+}
+/* Initialise journal that records nothing yet.
+ */
+void journal_init(journal *j)
+{
+	memset(j, 0, sizeof(journal));
+	j->fd = -1;
+}
+/* Get identity of file on disk.
+ */
+void journal_ident(const char *file, char *id)
+{
+	struct stat st;
+	if(stat(file, &st) < 0) {
+		strcpy(id, "none");
+		return;
+	}
+	sprintf(id, "%lu %lu %lu", (unsigned long)st.st_size,
+		(unsigned long)st.st_mtime, (unsigned long)st.st_ino);
+}
+/* Journal edits to file with identity 'id'.
+ */
+void journal_start(journal *j, const char *path, const char *id)
+{
+	journal_close(j, 1);
+	j->path = malloc(strlen(path)+1);
+	strcpy(j->path, path);
+	strcpy(j->id, id);
+}
+/* Replay journal left for the same file.
+ */
+long journal_replay(journal *j, int (*fn)(void *, int, int, int,
+	const char *, size_t), void *arg)
+{
+	struct jrec r;
+	struct stat st;
+	size_t len = 0, pos, end, start = 0;
+	unsigned int base = 0, seq = 0;
+	const char *id = NULL;
+	size_t idlen = 0;
+	long n = 0;
+	char *buf;
+	int fd, ok = 1;
+	if(j->path == NULL) return 0;
+	fd = open(j->path, O_RDWR);
+	if(fd < 0) return 0;
+	if(fstat(fd, &st) < 0 || st.st_size < JOURNAL_MAGIC_LEN) {
+		close(fd);
+		return 0;
+	}
+	buf = malloc(st.st_size);
+	while(len < (size_t)st.st_size) {
+		ssize_t got = read(fd, buf+len, st.st_size-len);
+		if(got < 0 && errno == EINTR) continue;
+		if(got <= 0) break;
+		len += got;
+	}
+	if(len < JOURNAL_MAGIC_LEN ||
+	    memcmp(buf, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0) {
+		free(buf);
+		close(fd);
+		return 0;
+	}
+	/* find the last base, a record cut short by a crash ends the file */
+	for(pos = JOURNAL_MAGIC_LEN; journal_parse(buf, len, pos, &r);
+	    pos = r.next) {
+		if(r.op == JOURNAL_BASE) {
+			base = r.row;
+			id = r.s;
+			idlen = r.len;
+		} else if(r.op == JOURNAL_SAVE && (unsigned int)r.row > seq) {
+			seq = r.row;
+		}
+	}
+	end = pos;
+	if(id == NULL || idlen != strlen(j->id) ||
+	    memcmp(id, j->id, idlen) != 0)
+		ok = 0;
+	/* edits after the snapshot the file holds are the lost ones */
+	for(pos = JOURNAL_MAGIC_LEN; ok && pos < end; pos = r.next) {
+		journal_parse(buf, len, pos, &r);
+		if(base == 0 || (r.op == JOURNAL_SAVE &&
+		    (unsigned int)r.row == base)) {
+			start = (base == 0) ? pos : r.next;
+			break;
+		}
+	}
+	if(ok && start == 0) ok = 0;
+	for(pos = start; ok && pos < end; pos = r.next) {
+		journal_parse(buf, len, pos, &r);
+		if(r.op >= JOURNAL_SAVE) continue;
+		if(fn(arg, r.op, r.row, r.col, r.s, r.len) < 0) {
+			/* the journal ends where the document stopped following
+			 * it, the edits applied stay journaled */
+			end = pos;
+			break;
+		}
+		n++;
+	}
+	free(buf);
+	if(!ok || (end < len && ftruncate(fd, end) < 0) ||
+	    lseek(fd, 0, SEEK_END) < 0) {
+		close(fd);
+		return n;
+	}
+	/* new records carry on after the replayed ones */
+	j->fd = fd;
+	j->head = 1;
+	j->seq = seq;
+	return n;
+}
+/* Make room for 'len' more waiting bytes.
+ */
+static void journal_reserve(journal *j, size_t len)
+{
+	if(j->cap-j->len < len) {
+		size_t cap = j->cap*2;
+		if(cap < j->len+len) cap = j->len+len+4096;
+		j->buf = realloc(j->buf, cap);
+		j->cap = cap;
+	}
+}
+/* Append edit to journal.
+ */
+void journal_add(journal *j, int op, int row, int col, const char *s,
+	size_t len)
+{
+	char *p;
+	if(j->path == NULL || j->failed) return;
+	if(!j->head) {
+		j->head = 1;
+		journal_reserve(j, JOURNAL_MAGIC_LEN);
+		memcpy(&j->buf[j->len], JOURNAL_MAGIC, JOURNAL_MAGIC_LEN);
+		j->len += JOURNAL_MAGIC_LEN;
+		journal_add(j, JOURNAL_BASE, 0, 0, j->id, strlen(j->id));
+	}
+	journal_reserve(j, JOURNAL_REC+len);
+	p = &j->buf[j->len];
+	p[0] = op;
+	put32(p+1, (unsigned long)row);
+	put32(p+5, (unsigned long)col);
+	put32(p+9, (unsigned long)len);
+	if(len > 0) memcpy(p+JOURNAL_REC, s, len);
+	j->len += JOURNAL_REC+len;
+}
+/* Mark snapshot taken for a save.
+ */
+unsigned int journal_save(journal *j)
+{
+	j->seq++;
+	journal_add(j, JOURNAL_SAVE, j->seq, 0, NULL, 0);
+	return j->seq;
+}
+/* File on disk now holds snapshot 'seq'.
+ */
+void journal_saved(journal *j, unsigned int seq, const char *id, int clean)
+{
+	strcpy(j->id, id);
+	if(j->path == NULL) return;
+	if(!clean) {
+		journal_add(j, JOURNAL_BASE, seq, 0, id, strlen(id));
+		return;
+	}
+	/* everything journaled is on disk, start over against the new file */
+	if(j->fd >= 0) close(j->fd);
+	unlink(j->path);
+	j->fd = -1;
+	j->len = 0;
+	j->head = 0;
+	j->failed = 0;
+	j->seq = 0;
+}
+/* Check if records have waited long enough.
+ */
+int journal_due(const journal *j)
+{
+	return j->len > 0 && !j->failed &&
+		journal_now()-j->last >= JOURNAL_FLUSH_MS/1000.0;
+}
+/* Milliseconds until records have waited long enough.
+ */
+int journal_next(const journal *j)
+{
+	double left;
+	if(j->len == 0 || j->failed || j->out_len > 0) return -1;
+	left = j->last+JOURNAL_FLUSH_MS/1000.0-journal_now();
+	return left > 0 ? (int)(left*1000)+1 : 0;
+}
+/* Move waiting records out.
+ */
+void journal_take(journal *j)
+{
+	char *p = j->out;
+	size_t cap = j->out_cap;
+	if(j->out_len > 0 || j->len == 0) return;
+	j->out = j->buf;
+	j->out_cap = j->cap;
+	j->out_len = j->len;
+	j->buf = p;
+	j->cap = cap;
+	j->len = 0;
+	j->last = journal_now();
+}
+/* Write records moved out.
+ */
+int journal_write(journal *j)
+{
+	size_t done = 0;
+	if(j->out_len == 0 || j->failed) return 0;
+	if(j->fd < 0) {
+		j->fd = open(j->path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if(j->fd < 0) {
+			j->failed = 1;
+			return -1;
+		}
+	}
+	while(done < j->out_len) {
+		ssize_t w = write(j->fd, j->out+done, j->out_len-done);
+		if(w < 0 && errno == EINTR) continue;
+		if(w <= 0) {
+			j->failed = 1;
+			return -1;
+		}
+		done += w;
+	}
+	j->out_len = 0;
+	fdatasync(j->fd);
+	return 0;
+}
+/* Stop journaling.
+ */
+void journal_close(journal *j, int keep)
+{
+	if(keep && j->path != NULL) {
+		journal_write(j);
+		journal_take(j);
+		journal_write(j);
+	}
+	if(j->fd >= 0) close(j->fd);
+	if(!keep && j->path != NULL) unlink(j->path);
+	free(j->path);
+	free(j->buf);
+	free(j->out);
+	journal_init(j);
+}
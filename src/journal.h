@@ -0,0 +1,73 @@
+/**
+ * @file journal.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Append only crash recovery journal of document edits.
+ ********************************************************************
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+
+/* Milliseconds edits wait in memory before they are written as a group */
+#define JOURNAL_FLUSH_MS 500
+/* Room for the identity of a file on disk */
+#define JOURNAL_ID 64
+
+/* Journal records past the undo operations */
+enum journal_kind {
+	JOURNAL_SAVE = 16,	/* document snapshot taken for a save */
+	JOURNAL_BASE		/* file on disk holds snapshot 'row' */
+};
+/* Crash recovery journal, records wait in 'buf' until the worker moves
+ * them to 'out' and writes them */
+typedef struct journal {
+	char *path;
+	char id[JOURNAL_ID];
+	int fd;
+	int head;
+	int failed;
+	unsigned int seq;
+	char *buf;
+	size_t len, cap;
+	char *out;
+	size_t out_len, out_cap;
+	double last;
+} journal;
+
+/* Initialise journal that records nothing yet. */
+void journal_init(journal *j);
+/* Get identity of file on disk, changes whenever the file does. */
+void journal_ident(const char *file, char *id);
+/* Journal edits to file with identity 'id' at 'path', the journal file
+ * is only touched once edits are written. */
+void journal_start(journal *j, const char *path, const char *id);
+/* Replay journal left for the same file by calling 'fn' for each edit,
+ * returns number of edits replayed. The journal is cut at the first edit
+ * 'fn' refuses and new records go after the ones replayed. */
+long journal_replay(journal *j, int (*fn)(void *, int, int, int,
+	const char *, size_t), void *arg);
+/* Append edit to journal. */
+void journal_add(journal *j, int op, int row, int col, const char *s,
+	size_t len);
+/* Mark snapshot taken for a save, returns its number. */
+unsigned int journal_save(journal *j);
+/* File on disk now holds snapshot 'seq' and has identity 'id', 'clean' is
+ * set when nothing was edited since the snapshot. */
+void journal_saved(journal *j, unsigned int seq, const char *id, int clean);
+/* Check if records have waited long enough to be written. */
+int journal_due(const journal *j);
+/* Milliseconds until records are due to be written, -1 when nothing
+ * waits or a write is still going on. */
+int journal_next(const journal *j);
+/* Move waiting records out for journal_write() (lock held). */
+void journal_take(journal *j);
+/* Write records moved out (lock dropped), returns -1 on error. */
+int journal_write(journal *j);
+/* Stop journaling, writing what waits when 'keep' is set and removing
+ * the journal file otherwise. */
+void journal_close(journal *j, int keep);
+
+#endif
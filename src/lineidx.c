@@ -0,0 +1,337 @@
+/**
+ * @file lineidx.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Parallel line boundary index for PRS Edit.
+ *
+ * The buffer is cut into chunks that are scanned for '\n' with SSE2 or
+ * AVX2 compares (plain loop elsewhere). A first pass only counts the
+ * newlines of each chunk, which tells every chunk the number of its
+ * first line, and a second pass stores the line starts straight into
+ * the index. Only every 'stride'-th line start is kept, the row tree
+ * needs no more than the first line of each leaf, so no memory goes to
+ * lines that are not kept.
+ ************************************************************************
+ */
+
+#if defined(__FreeBSD__) || defined(__OpenBSD__)
+#define _BSD_SOURCE
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LINEIDX_X86
+#endif
+
+#include "lineidx.h"
+#include "pool.h"
+
+/* Scanning job for one chunk of the buffer */
+struct lineidx_job {
+	const char *buf;
+	size_t base;
+	size_t len;
+	int kernel;
+	int fill;
+	size_t n;
+	size_t crlf;
+	lineidx *idx;
+	size_t first;
+	size_t seen;
+	size_t next;
+};
+
+/* Take newline at chunk offset 'i', counting it or storing the start of
+ * the line after it when that line is kept.
+ */
+static void job_line(struct lineidx_job *j, size_t i)
+{
+	lineidx *idx = j->idx;
+	if(!j->fill) {
+		j->n++;
+		if(j->base+i > 0 && j->buf[j->base+i-1] == '\r') j->crlf++;
+		return;
+	}
+	if(j->seen++ == j->next) {
+		/* line k starts after newline k-1 */
+		size_t line = j->first+j->seen;
+		if(line < idx->lines)
+			idx->start[line/idx->stride] = j->base+i+1;
+		j->next += idx->stride;
+	}
+}
+/* Take newlines of the 64 byte block at chunk offset 'i' while filling,
+ * bit k of 'm' is set for a newline at 'i+k'.
+ */
+static void job_block(struct lineidx_job *j, size_t i, unsigned long long m)
+{
+	while(m != 0) {
+		int c = __builtin_popcountll(m);
+		if(j->seen+c <= j->next) {
+			j->seen += c;
+			return;
+		}
+		for(; j->seen < j->next; j->seen++)
+			m &= m-1;
+		job_line(j, i+__builtin_ctzll(m));
+		m &= m-1;
+	}
+}
+/* Scan chunk from 'i' to 'end' with the C library.
+ */
+static void scan_scalar(struct lineidx_job *j, size_t i, size_t end)
+{
+	const char *p = j->buf+j->base, *nl;
+	for(; i < end && (nl = memchr(p+i, '\n', end-i)) != NULL;
+	    i = nl-p+1)
+		job_line(j, nl-p);
+}
+#ifdef LINEIDX_X86
+/* Count newlines of chunk sixteen bytes at a time, the byte counters
+ * are summed before they can wrap.
+ */
+static void count_sse2(struct lineidx_job *j)
+{
+	const char *p = j->buf+j->base;
+	__m128i nl = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+	__m128i zero = _mm_setzero_si128();
+	size_t i = 1;
+	scan_scalar(j, 0, 1);
+	while(i+16 <= j->len) {
+		__m128i n = zero, c = zero;
+		size_t stop = i+255*16;
+		for(; i+16 <= j->len && i < stop; i += 16) {
+			__m128i e = _mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i*)(p+i)), nl);
+			__m128i r = _mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i*)(p+i-1)), cr);
+			n = _mm_sub_epi8(n, e);
+			c = _mm_sub_epi8(c, _mm_and_si128(e, r));
+		}
+		n = _mm_sad_epu8(n, zero);
+		c = _mm_sad_epu8(c, zero);
+		j->n += _mm_cvtsi128_si32(n)+
+			_mm_cvtsi128_si32(_mm_srli_si128(n, 8));
+		j->crlf += _mm_cvtsi128_si32(c)+
+			_mm_cvtsi128_si32(_mm_srli_si128(c, 8));
+	}
+	scan_scalar(j, i, j->len);
+}
+/* Fill index from chunk sixty four bytes at a time.
+ */
+static void fill_sse2(struct lineidx_job *j)
+{
+	const char *p = j->buf+j->base;
+	__m128i nl = _mm_set1_epi8('\n');
+	size_t i;
+	for(i = 0; i+64 <= j->len; i += 64) {
+		unsigned long long m = 0;
+		int k;
+		for(k = 0; k < 4; k++)
+			m |= (unsigned long long)(unsigned int)_mm_movemask_epi8(
+				_mm_cmpeq_epi8(_mm_loadu_si128(
+				(const __m128i*)(p+i+k*16)), nl)) << k*16;
+		if(m != 0) job_block(j, i, m);
+	}
+	scan_scalar(j, i, j->len);
+}
+/* Count newlines of chunk thirty two bytes at a time.
+ */
+__attribute__((target("avx2")))
+static void count_avx2(struct lineidx_job *j)
+{
+	const char *p = j->buf+j->base;
+	__m256i nl = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+	__m256i zero = _mm256_setzero_si256();
+	size_t i = 1;
+	scan_scalar(j, 0, 1);
+	while(i+32 <= j->len) {
+		__m256i n = zero, c = zero;
+		__m128i sn, sc;
+		size_t stop = i+255*32;
+		for(; i+32 <= j->len && i < stop; i += 32) {
+			__m256i e = _mm256_cmpeq_epi8(
+				_mm256_loadu_si256((const __m256i*)(p+i)), nl);
+			__m256i r = _mm256_cmpeq_epi8(
+				_mm256_loadu_si256((const __m256i*)(p+i-1)), cr);
+			n = _mm256_sub_epi8(n, e);
+			c = _mm256_sub_epi8(c, _mm256_and_si256(e, r));
+		}
+		n = _mm256_sad_epu8(n, zero);
+		c = _mm256_sad_epu8(c, zero);
+		sn = _mm_add_epi64(_mm256_castsi256_si128(n),
+			_mm256_extracti128_si256(n, 1));
+		sc = _mm_add_epi64(_mm256_castsi256_si128(c),
+			_mm256_extracti128_si256(c, 1));
+		j->n += _mm_cvtsi128_si32(sn)+
+			_mm_cvtsi128_si32(_mm_srli_si128(sn, 8));
+		j->crlf += _mm_cvtsi128_si32(sc)+
+			_mm_cvtsi128_si32(_mm_srli_si128(sc, 8));
+	}
+	scan_scalar(j, i, j->len);
+}
+/* Fill index from chunk sixty four bytes at a time.
+ */
+__attribute__((target("avx2,popcnt")))
+static void fill_avx2(struct lineidx_job *j)
+{
+	const char *p = j->buf+j->base;
+	__m256i nl = _mm256_set1_epi8('\n');
+	size_t i;
+	for(i = 0; i+64 <= j->len; i += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(p+i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(p+i+32));
+		unsigned long long m = (unsigned int)
+			_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, nl));
+		m |= (unsigned long long)(unsigned int)
+			_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl)) << 32;
+		if(m != 0) job_block(j, i, m);
+	}
+	scan_scalar(j, i, j->len);
+}
+#endif
+/* Run scanning job with its kernel, counting or filling.
+ */
+static void scan_job(void *arg, int worker)
+{
+	struct lineidx_job *j = arg;
+	switch(j->kernel) {
+#ifdef LINEIDX_X86
+	case LINEIDX_AVX2:
+		if(j->fill) fill_avx2(j);
+		else count_avx2(j);
+		break;
+	case LINEIDX_SSE2:
+		if(j->fill) fill_sse2(j);
+		else count_sse2(j);
+		break;
+#endif
+	default:
+		scan_scalar(j, 0, j->len);
+		break;
+	}
+}
+/* Run every scanning job, on the pool unless a single thread is wanted.
+ */
+static void scan_jobs(struct lineidx_job *job, int njob, int threads)
+{
+	int i;
+	if(threads == 1) {
+		for(i = 0; i < njob; i++)
+			scan_job(&job[i], 0);
+	} else {
+		pool_run(scan_job, job, sizeof(struct lineidx_job), njob);
+	}
+}
+/* Fastest kernel the running CPU supports.
+ */
+int lineidx_best_kernel(void)
+{
+#ifdef LINEIDX_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) return LINEIDX_AVX2;
+	if(__builtin_cpu_supports("sse2")) return LINEIDX_SSE2;
+#endif
+	return LINEIDX_SCALAR;
+}
+/* Name of scanning kernel.
+ */
+const char *lineidx_kernel_name(int kernel)
+{
+	switch(kernel) {
+	case LINEIDX_SCALAR: return "scalar";
+	case LINEIDX_SSE2: return "sse2";
+	case LINEIDX_AVX2: return "avx2";
+	default: return "auto";
+	}
+}
+/* Index lines of buffer with given kernel and thread count.
+ */
+int lineidx_build_with(lineidx *idx, const char *buf, size_t len,
+	int stride, int kernel, int threads)
+{
+	struct lineidx_job *job;
+	size_t nl = 0, chunk = LINEIDX_CHUNK;
+	int i, njob;
+	if(stride < 1) stride = 1;
+	if(kernel == LINEIDX_AUTO) kernel = lineidx_best_kernel();
+#ifndef LINEIDX_X86
+	kernel = LINEIDX_SCALAR;
+#endif
+	memset(idx, 0, sizeof(lineidx));
+	idx->stride = stride;
+	if(len == 0) return 0;
+
+	/* no more jobs than threads asked for, bigger chunks instead */
+	njob = (int)((len+chunk-1)/chunk);
+	if(threads > 0 && njob > threads) {
+		njob = threads;
+		chunk = (len+njob-1)/njob;
+	}
+	job = calloc(njob, sizeof(struct lineidx_job));
+	if(job == NULL) return -1;
+	for(i = 0; i < njob; i++) {
+		job[i].buf = buf;
+		job[i].base = (size_t)i*chunk;
+		job[i].len = len-job[i].base;
+		if(job[i].len > chunk) job[i].len = chunk;
+		job[i].kernel = kernel;
+		job[i].idx = idx;
+	}
+
+	/* count the newlines of every chunk */
+	scan_jobs(job, njob, threads);
+	for(i = 0; i < njob; i++) {
+		job[i].first = nl;
+		nl += job[i].n;
+		idx->crlf += job[i].crlf;
+	}
+	idx->lines = (buf[len-1] == '\n') ? nl : nl+1;
+	idx->nstart = (idx->lines+stride-1)/stride;
+	idx->start = malloc(sizeof(size_t)*idx->nstart);
+	if(idx->start == NULL) {
+		free(job);
+		return -1;
+	}
+	idx->start[0] = 0;
+
+	/* then let every chunk store the line starts that fall in it */
+	for(i = 0; i < njob; i++) {
+		job[i].fill = 1;
+		job[i].next = (stride-(job[i].first+1)%stride)%stride;
+	}
+	scan_jobs(job, njob, threads);
+	free(job);
+	return 0;
+}
+/* Count new lines of buffer.
+ */
+size_t lineidx_count(const char *buf, size_t len)
+{
+	struct lineidx_job j;
+	memset(&j, 0, sizeof(j));
+	j.buf = buf;
+	j.len = len;
+	j.kernel = lineidx_best_kernel();
+	scan_job(&j, 0);
+	return j.n;
+}
+/* Index lines of buffer.
+ */
+int lineidx_build(lineidx *idx, const char *buf, size_t len, int stride)
+{
+	return lineidx_build_with(idx, buf, len, stride, LINEIDX_AUTO, 0);
+}
+/* Free line index.
+ */
+void lineidx_free(lineidx *idx)
+{
+	free(idx->start);
+	idx->start = NULL;
+	idx->nstart = 0;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file lineidx.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Parallel line boundary index for loading files.
+ ********************************************************************
+ */
+
+#ifndef LINEIDX_H
+#define LINEIDX_H
+
+#include <stddef.h>
+
+/* Bytes scanned by one worker job */
+#define LINEIDX_CHUNK (16*1024*1024)
+
+/* Line scanning kernels */
+enum lineidx_kernel {
+	LINEIDX_AUTO = 0,
+	LINEIDX_SCALAR,
+	LINEIDX_SSE2,
+	LINEIDX_AVX2
+};
+/* Line index structure, keeps start of every 'stride'-th line */
+typedef struct lineidx {
+	size_t *start;
+	size_t nstart;
+	size_t lines;
+	size_t crlf;
+	int stride;
+} lineidx;
+
+/* Index lines of buffer using the best kernel and all threads. */
+int lineidx_build(lineidx *idx, const char *buf, size_t len, int stride);
+/* Index lines of buffer with given kernel and at most 'threads' threads
+ * (0 for all of them). */
+int lineidx_build_with(lineidx *idx, const char *buf, size_t len,
+	int stride, int kernel, int threads);
+/* Count new lines of buffer with the best kernel on this thread. */
+size_t lineidx_count(const char *buf, size_t len);
+/* Fastest kernel the running CPU supports. */
+int lineidx_best_kernel(void);
+/* Name of scanning kernel. */
+const char *lineidx_kernel_name(int kernel);
+/* Free line index. */
+void lineidx_free(lineidx *idx);
+
+#endif
@@ -8,24 +8,29 @@
 
 #include <stdio.h>
 #include "edit.h"
+#include "stream.h"
 
 /* Simple Text Editor (prsed).
  */
 int main(int argc, char **argv)
 {
+	/* options run a script over text, no terminal needed */
+	if(argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0')
+		return stream_main(argc, argv);
 	enable_raw();
 	init_editor();
 	if(argc > 2) {
 		fprintf(stderr, "Usage: %s [filename.ext]\n", argv[0]);
 		return 1;
 	}
+	editor_set_status("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find"
+			" | Ctrl-K = delete row | Ctrl-U = undo");
+	/* opening a file may have something more important to say */
 	if(argc == 2) {
 		editor_open(argv[1]);
 	}
-	editor_set_status("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find"
-			" | Ctrl-K = delete row | Ctrl-U = undo");
 	while(1) {
-		editor_refresh_screen();
+		editor_schedule_refresh();
 		editor_process_key();
 	}
 	return 0;
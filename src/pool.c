@@ -0,0 +1,92 @@
+/**
+ * @file pool.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Small worker thread pool for PRS Edit.
+ *
+ * Workers pull job indexes from a shared counter until the batch is
+ * done, the calling thread works on the batch as well so a machine
+ * with a single CPU never starts any threads at all.
+ ************************************************************************
+ */
+
+#if defined(__FreeBSD__) || defined(__OpenBSD__)
+#define _BSD_SOURCE
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/* Job batch shared by pool workers */
+struct pool_batch {
+	void (*fn)(void *, int);
+	char *jobs;
+	size_t size;
+	int n;
+	int next;
+	pthread_mutex_t lock;
+};
+/* Pool worker, 'id' 0 is the calling thread */
+struct pool_worker {
+	struct pool_batch *b;
+	int id;
+};
+
+/* Number of threads worth using on this machine.
+ */
+int pool_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if(n < 1) n = 1;
+	if(n > POOL_MAX_THREADS) n = POOL_MAX_THREADS;
+	return (int)n;
+}
+/* Worker loop, runs jobs until the batch is empty.
+ */
+static void *pool_worker(void *arg)
+{
+	struct pool_worker *w = arg;
+	struct pool_batch *b = w->b;
+	while(1) {
+		int i;
+		pthread_mutex_lock(&b->lock);
+		i = b->next++;
+		pthread_mutex_unlock(&b->lock);
+		if(i >= b->n) break;
+		b->fn(b->jobs+i*b->size, w->id);
+	}
+	return NULL;
+}
+/* Run every job of the batch on the pool.
+ */
+void pool_run(void (*fn)(void *, int), void *jobs, size_t size, int n)
+{
+	pthread_t tid[POOL_MAX_THREADS];
+	struct pool_worker w[POOL_MAX_THREADS];
+	struct pool_batch b;
+	int i, started = 0, threads = pool_threads();
+	if(threads > n) threads = n;
+	b.fn = fn;
+	b.jobs = jobs;
+	b.size = size;
+	b.n = n;
+	b.next = 0;
+	pthread_mutex_init(&b.lock, NULL);
+	for(i = 0; i < threads; i++) {
+		w[i].b = &b;
+		w[i].id = i;
+	}
+	for(i = 1; i < threads; i++) {
+		if(pthread_create(&tid[started], NULL, pool_worker, &w[i]) != 0)
+			break;
+		started++;
+	}
+	pool_worker(&w[0]);
+	for(i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+	pthread_mutex_destroy(&b.lock);
+}
@@ -0,0 +1,24 @@
+/**
+ * @file pool.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Small worker thread pool for splitting whole buffer scans.
+ ********************************************************************
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/* Upper limit of worker threads used for one job batch */
+#define POOL_MAX_THREADS 16
+
+/* Number of threads worth using on this machine. */
+int pool_threads(void);
+/* Run 'fn' on each of 'n' jobs of 'size' bytes, return when all are done.
+ * 'fn' is told which worker runs it, from 0 (the caller) to below
+ * pool_threads(). */
+void pool_run(void (*fn)(void *, int), void *jobs, size_t size, int n);
+
+#endif
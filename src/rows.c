@@ -0,0 +1,415 @@
+/**
+ * @file rows.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Document row store for PRS Edit.
+ *
+ * Rows live in leaf chunks of a counted B+tree, every interior node
+ * keeps the number of rows below it so that lookup, insert and delete
+ * by line number are all O(log n). Leaves are chained so that whole
+ * document walks (save, search) never go back through the tree.
+ *
+ * A tree built over a memory mapped file starts out with lazy leaves,
+ * they only point at the first byte of their lines and are turned into
+ * row views the first time something looks inside them. Nodes come from
+ * the document slab so a whole tree can be dropped in one go.
+ ************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rows.h"
+#include "slab.h"
+
+/* Underflow limits before a node is merged or refilled */
+#define ROWS_LEAF_MIN (ROWS_LEAF_MAX/4)
+#define ROWS_NODE_MIN (ROWS_NODE_MAX/4)
+
+/* Allocate a new tree node.
+ */
+static rownode *node_new(const rowtree *t, int leaf)
+{
+	rownode *n = slab_calloc(t->slab, sizeof(rownode));
+	n->leaf = leaf;
+	if(leaf) n->row = slab_alloc(t->slab, sizeof(erow)*ROWS_LEAF_MAX);
+	else n->kid = slab_alloc(t->slab, sizeof(rownode*)*ROWS_NODE_MAX);
+	return n;
+}
+/* Free node and everything below it.
+ */
+static void node_free(const rowtree *t, rownode *n)
+{
+	int i;
+	if(n == NULL) return;
+	if(!n->leaf) {
+		for(i = 0; i < n->n; i++)
+			node_free(t, n->kid[i]);
+		slab_free(t->slab, n->kid, sizeof(rownode*)*ROWS_NODE_MAX);
+	} else if(n->row != NULL) {
+		slab_free(t->slab, n->row, sizeof(erow)*ROWS_LEAF_MAX);
+	}
+	slab_free(t->slab, n, sizeof(rownode));
+}
+/* Find end of mapped line starting at 'p', return start of next line.
+ */
+static const char *map_line(const char *p, const char *end, int *len)
+{
+	const char *nl = memchr(p, '\n', end-p);
+	const char *q = (nl != NULL) ? nl : end;
+	while(q > p && q[-1] == '\r') q--;
+	*len = q-p;
+	return (nl != NULL) ? nl+1 : end;
+}
+/* Turn a lazily mapped leaf into row views.
+ */
+static void leaf_load(const rowtree *t, rownode *n)
+{
+	const char *p = n->map;
+	int i;
+	if(n->row != NULL) return;
+	n->row = slab_alloc(t->slab, sizeof(erow)*ROWS_LEAF_MAX);
+	for(i = 0; i < n->n; i++) {
+		erow *row = &n->row[i];
+		row->data = (char*)p;
+		p = map_line(p, t->map_end, &row->size);
+		row->rsize = 0;
+		row->render = NULL;
+		row->hl = NULL;
+		row->mapped = 1;
+		row->cap = row->size;
+		row->gap = row->size;
+		row->tabs = -1;
+		row->hl_end = -1;
+		row->hl_gen = 0;
+		row->version = 0;
+	}
+	n->map = NULL;
+}
+/* Recalculate row count of interior node from its children.
+ */
+static void node_sum(rownode *n)
+{
+	int i;
+	if(n->leaf) {
+		n->count = n->n;
+		return;
+	}
+	n->count = 0;
+	for(i = 0; i < n->n; i++)
+		n->count += n->kid[i]->count;
+}
+/* Split node keeping 'keep' entries, return new right sibling.
+ */
+static rownode *node_split(const rowtree *t, rownode *n, int keep)
+{
+	rownode *s = node_new(t, n->leaf);
+	s->n = n->n-keep;
+	if(n->leaf) {
+		memcpy(s->row, &n->row[keep], sizeof(erow)*s->n);
+		s->next = n->next;
+		s->prev = n;
+		if(n->next != NULL) n->next->prev = s;
+		n->next = s;
+	} else {
+		memcpy(s->kid, &n->kid[keep], sizeof(rownode*)*s->n);
+	}
+	n->n = keep;
+	node_sum(n);
+	node_sum(s);
+	return s;
+}
+/* Insert row into node, return new sibling if the node was split.
+ */
+static rownode *node_insert(const rowtree *tree, rownode *n, int at,
+	const erow *row)
+{
+	rownode *s = NULL, *t = n;
+	int i;
+	if(n->leaf) {
+		leaf_load(tree, n);
+		if(n->n == ROWS_LEAF_MAX) {
+			/* sequential loads append to the last leaf, keep it full */
+			s = node_split(tree, n, (n->next == NULL && at == n->n) ?
+				n->n : n->n/2);
+			if(at > n->n || n->n == ROWS_LEAF_MAX) {
+				at -= n->n;
+				t = s;
+			}
+		}
+		memmove(&t->row[at+1], &t->row[at], sizeof(erow)*(t->n-at));
+		t->row[at] = *row;
+		t->n++;
+		t->count = t->n;
+		return s;
+	}
+	for(i = 0; i < n->n-1 && at > n->kid[i]->count; i++)
+		at -= n->kid[i]->count;
+	s = node_insert(tree, n->kid[i], at, row);
+	n->count++;
+	if(s == NULL) return NULL;
+	/* link new child after the one that split */
+	i++;
+	if(n->n == ROWS_NODE_MAX) {
+		t = node_split(tree, n, n->n/2);
+		if(i > n->n) {
+			i -= n->n;
+			n = t;
+		}
+	} else {
+		t = NULL;
+	}
+	memmove(&n->kid[i+1], &n->kid[i], sizeof(rownode*)*(n->n-i));
+	n->kid[i] = s;
+	n->n++;
+	node_sum(n);
+	return t;
+}
+/* Merge or rebalance child 'i' of node after it lost an entry.
+ */
+static void node_fix(const rowtree *t, rownode *n, int i)
+{
+	rownode *a, *b;
+	int min, max, want;
+	if(n->kid[i]->leaf) {
+		min = ROWS_LEAF_MIN;
+		max = ROWS_LEAF_MAX;
+	} else {
+		min = ROWS_NODE_MIN;
+		max = ROWS_NODE_MAX;
+	}
+	if(n->kid[i]->n >= min || n->n < 2) return;
+	if(i == n->n-1) i--;
+	a = n->kid[i];
+	b = n->kid[i+1];
+	if(a->leaf) {
+		leaf_load(t, a);
+		leaf_load(t, b);
+	}
+	if(a->n+b->n <= max) {
+		/* merge right sibling into left one */
+		if(a->leaf) {
+			memcpy(&a->row[a->n], b->row, sizeof(erow)*b->n);
+			a->next = b->next;
+			if(b->next != NULL) b->next->prev = a;
+		} else {
+			memcpy(&a->kid[a->n], b->kid, sizeof(rownode*)*b->n);
+		}
+		a->n += b->n;
+		b->n = 0;
+		node_sum(a);
+		node_free(t, b);
+		memmove(&n->kid[i+1], &n->kid[i+2],
+			sizeof(rownode*)*(n->n-i-2));
+		n->n--;
+		return;
+	}
+	/* share entries evenly between the two siblings */
+	want = (a->n+b->n)/2;
+	if(a->leaf) {
+		if(a->n > want) {
+			int k = a->n-want;
+			memmove(&b->row[k], b->row, sizeof(erow)*b->n);
+			memcpy(b->row, &a->row[want], sizeof(erow)*k);
+			a->n -= k;
+			b->n += k;
+		} else {
+			int k = want-a->n;
+			memcpy(&a->row[a->n], b->row, sizeof(erow)*k);
+			memmove(b->row, &b->row[k], sizeof(erow)*(b->n-k));
+			a->n += k;
+			b->n -= k;
+		}
+	} else {
+		if(a->n > want) {
+			int k = a->n-want;
+			memmove(&b->kid[k], b->kid, sizeof(rownode*)*b->n);
+			memcpy(b->kid, &a->kid[want], sizeof(rownode*)*k);
+			a->n -= k;
+			b->n += k;
+		} else {
+			int k = want-a->n;
+			memcpy(&a->kid[a->n], b->kid, sizeof(rownode*)*k);
+			memmove(b->kid, &b->kid[k], sizeof(rownode*)*(b->n-k));
+			a->n += k;
+			b->n -= k;
+		}
+	}
+	node_sum(a);
+	node_sum(b);
+}
+/* Delete row from node.
+ */
+static void node_delete(const rowtree *t, rownode *n, int at)
+{
+	int i;
+	if(n->leaf) {
+		leaf_load(t, n);
+		memmove(&n->row[at], &n->row[at+1], sizeof(erow)*(n->n-at-1));
+		n->n--;
+		n->count--;
+		return;
+	}
+	for(i = 0; at >= n->kid[i]->count; i++)
+		at -= n->kid[i]->count;
+	node_delete(t, n->kid[i], at);
+	n->count--;
+	node_fix(t, n, i);
+}
+/* Initialise an empty row tree.
+ */
+void rows_init(rowtree *t, slab *s)
+{
+	t->slab = s;
+	t->root = node_new(t, 1);
+	t->first = t->root;
+	t->map_end = NULL;
+}
+/* Release all tree nodes.
+ */
+void rows_free(rowtree *t)
+{
+	node_free(t, t->root);
+	rows_drop(t);
+}
+/* Forget tree nodes, used when their slab is released as a whole.
+ */
+void rows_drop(rowtree *t)
+{
+	t->root = NULL;
+	t->first = NULL;
+}
+/* Number of rows in tree.
+ */
+int rows_count(const rowtree *t)
+{
+	return t->root != NULL ? t->root->count : 0;
+}
+/* Find leaf holding row 'at'.
+ */
+rownode *rows_leaf(const rowtree *t, int at, int *off)
+{
+	rownode *n = t->root;
+	if(n == NULL || at < 0 || at >= n->count) return NULL;
+	while(!n->leaf) {
+		int i;
+		for(i = 0; at >= n->kid[i]->count; i++)
+			at -= n->kid[i]->count;
+		n = n->kid[i];
+	}
+	leaf_load(t, n);
+	*off = at;
+	return n;
+}
+/* Get row at index.
+ */
+erow *rows_get(const rowtree *t, int at)
+{
+	int off;
+	rownode *n = rows_leaf(t, at, &off);
+	return n != NULL ? &n->row[off] : NULL;
+}
+/* Insert row before index 'at'.
+ */
+void rows_insert(rowtree *t, int at, const erow *row)
+{
+	rownode *s;
+	if(at < 0 || at > rows_count(t)) return;
+	s = node_insert(t, t->root, at, row);
+	if(s != NULL) {
+		rownode *r = node_new(t, 0);
+		r->kid[0] = t->root;
+		r->kid[1] = s;
+		r->n = 2;
+		node_sum(r);
+		t->root = r;
+	}
+}
+/* Delete row at index 'at'.
+ */
+void rows_delete(rowtree *t, int at)
+{
+	if(at < 0 || at >= rows_count(t)) return;
+	node_delete(t, t->root, at);
+	while(!t->root->leaf && t->root->n == 1) {
+		rownode *r = t->root;
+		t->root = r->kid[0];
+		r->n = 0;
+		node_free(t, r);
+	}
+}
+/* Build tree over mapped file, leaves stay lazy until first used.
+ * 'start' holds the offset of every ROWS_LEAF_MAX-th line.
+ */
+int rows_map(rowtree *t, const char *map, size_t len, const size_t *start,
+	int lines)
+{
+	rownode **lv, *prev = NULL;
+	int i, nlv;
+	t->map_end = map+len;
+	if(lines <= 0) return 0;
+	nlv = (lines+ROWS_LEAF_MAX-1)/ROWS_LEAF_MAX;
+	lv = malloc(sizeof(rownode*)*nlv);
+	for(i = 0; i < nlv; i++) {
+		rownode *n = slab_calloc(t->slab, sizeof(rownode));
+		n->leaf = 1;
+		n->map = map+start[i];
+		n->map_len = (i+1 < nlv ? start[i+1] : len)-start[i];
+		n->n = lines-i*ROWS_LEAF_MAX;
+		if(n->n > ROWS_LEAF_MAX) n->n = ROWS_LEAF_MAX;
+		n->count = n->n;
+		n->prev = prev;
+		if(prev != NULL) prev->next = n;
+		prev = n;
+		lv[i] = n;
+	}
+	node_free(t, t->root);
+	t->first = lv[0];
+	/* stack interior levels evenly until a single root is left */
+	while(nlv > 1) {
+		int groups = (nlv+ROWS_NODE_MAX-1)/ROWS_NODE_MAX;
+		int g, k = 0;
+		for(g = 0; g < groups; g++) {
+			int take = nlv/groups+(g < nlv%groups);
+			rownode *r = node_new(t, 0);
+			for(i = 0; i < take; i++)
+				r->kid[i] = lv[k++];
+			r->n = take;
+			node_sum(r);
+			lv[g] = r;
+		}
+		nlv = groups;
+	}
+	t->root = lv[0];
+	free(lv);
+	return t->root->count;
+}
+/* Start iterating rows from the first one.
+ */
+void rows_iter(rowiter *it, const rowtree *t)
+{
+	it->t = t;
+	it->n = t->first;
+	it->i = 0;
+	it->p = (it->n != NULL) ? it->n->map : NULL;
+}
+/* Get text of next row.
+ */
+int rows_next(rowiter *it, const char **s, int *len)
+{
+	while(it->n != NULL && it->i >= it->n->n) {
+		it->n = it->n->next;
+		it->i = 0;
+		it->p = (it->n != NULL) ? it->n->map : NULL;
+	}
+	if(it->n == NULL) return 0;
+	if(it->n->row != NULL) {
+		*s = it->n->row[it->i].data;
+		*len = it->n->row[it->i].size;
+	} else {
+		*s = it->p;
+		it->p = map_line(it->p, it->t->map_end, len);
+	}
+	it->i++;
+	return 1;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file rows.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Document row store (counted B+tree of row chunks).
+ ********************************************************************
+ */
+
+#ifndef ROWS_H
+#define ROWS_H
+
+#include <stddef.h>
+
+#include "slab.h"
+
+/* Maximum rows held by one leaf chunk */
+#define ROWS_LEAF_MAX 64
+/* Maximum children held by one interior node */
+#define ROWS_NODE_MAX 32
+
+/* Editor row structure, text of the row being edited has a gap at 'gap' */
+typedef struct erow {
+	int size;
+	int rsize;
+	char *data;
+	char *render;
+	unsigned char *hl;
+	int mapped;
+	int cap;
+	int gap;
+	int tabs;
+	int hl_end;
+	unsigned int hl_gen;
+	unsigned int version;
+} erow;
+/* Physical index of logical position 'i' in row data */
+#define ROW_AT(row, i) ((i) < (row)->gap ? (i) : (i)+(row)->cap-(row)->size)
+/* Row tree node; leaves are chained for in-order walks, lazy leaves
+ * keep the mapped text of their rows in 'map' and 'map_len'. */
+typedef struct rownode {
+	int leaf;
+	int n;
+	int count;
+	struct rownode *next;
+	struct rownode *prev;
+	struct rownode **kid;
+	erow *row;
+	const char *map;
+	size_t map_len;
+} rownode;
+/* Row tree structure */
+typedef struct rowtree {
+	rownode *root;
+	rownode *first;
+	const char *map_end;
+	slab *slab;
+} rowtree;
+/* Row text iterator, walks mapped leaves without loading them. */
+typedef struct rowiter {
+	const rowtree *t;
+	rownode *n;
+	int i;
+	const char *p;
+} rowiter;
+
+/* Initialise an empty row tree taking its nodes from slab 's'. */
+void rows_init(rowtree *t, slab *s);
+/* Release tree nodes (row contents are owned by the caller). */
+void rows_free(rowtree *t);
+/* Forget tree nodes without freeing them, the slab goes as a whole. */
+void rows_drop(rowtree *t);
+/* Number of rows stored in tree. */
+int rows_count(const rowtree *t);
+/* Get row at index (NULL when out of range). */
+erow *rows_get(const rowtree *t, int at);
+/* Get leaf holding row at index, storing index within leaf in 'off'. */
+rownode *rows_leaf(const rowtree *t, int at, int *off);
+/* Insert copy of row structure before index 'at'. */
+void rows_insert(rowtree *t, int at, const erow *row);
+/* Remove row structure at index 'at'. */
+void rows_delete(rowtree *t, int at);
+/* Build tree of lazily loaded leaves over mapped file, return row count. */
+int rows_map(rowtree *t, const char *map, size_t len, const size_t *start,
+	int lines);
+/* Start iterating text of every row from the first one. */
+void rows_iter(rowiter *it, const rowtree *t);
+/* Get text of next row, returns zero when there are no more rows. */
+int rows_next(rowiter *it, const char **s, int *len);
+
+#endif
@@ -0,0 +1,365 @@
+/**
+ * @file screen.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Terminal screen model for PRS Edit.
+ *
+ * The editor draws every frame into a back buffer of cells, the flush
+ * compares it with the front buffer (what the terminal shows) and only
+ * sends the spans that changed. Scrolling by a few lines is done with a
+ * terminal scroll region so that the shifted lines need not be resent.
+ *
+ * Output is assembled in a frame buffer that keeps its capacity from
+ * frame to frame, runs of cells with the same colour are copied in one
+ * go and graphic rendition is only sent when it really changes.
+ ************************************************************************
+ */
+
+#if defined(__FreeBSD__) || defined(__OpenBSD__)
+#define _BSD_SOURCE
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+/* Unchanged cells bridged instead of moving the cursor over them */
+#define SCREEN_GAP 8
+/* Initial frame buffer capacity */
+#define FBUF_INIT 4096
+
+/* Frame buffer structure, reused for every frame */
+struct fbuf {
+	char *b;
+	size_t len;
+	size_t cap;
+};
+/* Screen cells, one array per cell field */
+struct cells {
+	char *ch;
+	unsigned char *fg;
+	unsigned char *attr;
+};
+/* Screen state */
+static struct {
+	int rows, cols;
+	struct cells back;
+	struct cells front;
+	int full;
+	int scroll_top, scroll_bottom, scroll_n;
+	int sgr_fg, sgr_attr, sgr_known;
+	struct fbuf out;
+	void (*sink)(const char *, size_t);
+	struct screen_stats st;
+} scr;
+
+/* Make room for 'len' more bytes in frame buffer.
+ */
+static char *fb_reserve(struct fbuf *fb, size_t len)
+{
+	if(fb->len+len > fb->cap) {
+		size_t cap = fb->cap ? fb->cap : FBUF_INIT;
+		while(cap < fb->len+len) cap *= 2;
+		fb->b = realloc(fb->b, cap);
+		fb->cap = cap;
+	}
+	return &fb->b[fb->len];
+}
+/* Append bytes to frame buffer.
+ */
+static void fb_append(struct fbuf *fb, const char *s, size_t len)
+{
+	memcpy(fb_reserve(fb, len), s, len);
+	fb->len += len;
+}
+/* Append decimal number to frame buffer.
+ */
+static void fb_num(struct fbuf *fb, unsigned int n)
+{
+	char buf[12];
+	int i = sizeof(buf);
+	do {
+		buf[--i] = '0'+n%10;
+		n /= 10;
+	} while(n != 0);
+	fb_append(fb, &buf[i], sizeof(buf)-i);
+}
+/* Allocate cell arrays.
+ */
+static void cells_alloc(struct cells *c, size_t n)
+{
+	c->ch = malloc(n);
+	c->fg = calloc(n, 1);
+	c->attr = calloc(n, 1);
+	memset(c->ch, ' ', n);
+}
+/* Free cell arrays.
+ */
+static void cells_free(struct cells *c)
+{
+	free(c->ch);
+	free(c->fg);
+	free(c->attr);
+	c->ch = NULL;
+	c->fg = NULL;
+	c->attr = NULL;
+}
+/* Send output somewhere else.
+ */
+void screen_output(void (*fn)(const char *s, size_t len))
+{
+	scr.sink = fn;
+}
+/* Resize screen buffers.
+ */
+void screen_resize(int rows, int cols)
+{
+	cells_free(&scr.back);
+	cells_free(&scr.front);
+	scr.rows = rows;
+	scr.cols = cols;
+	cells_alloc(&scr.back, (size_t)rows*cols);
+	cells_alloc(&scr.front, (size_t)rows*cols);
+	scr.full = 1;
+	scr.scroll_n = 0;
+}
+/* Free screen buffers.
+ */
+void screen_free(void)
+{
+	cells_free(&scr.back);
+	cells_free(&scr.front);
+	free(scr.out.b);
+	memset(&scr.out, 0, sizeof(scr.out));
+	scr.rows = 0;
+	scr.cols = 0;
+}
+/* Force a full redraw on next flush.
+ */
+void screen_invalidate(void)
+{
+	scr.full = 1;
+}
+/* Put text into back buffer line.
+ */
+int screen_text(int y, int x, const char *s, int len, int fg, int attr)
+{
+	size_t at = (size_t)y*scr.cols+x;
+	if(len > scr.cols-x) len = scr.cols-x;
+	if(len <= 0) return x;
+	memcpy(&scr.back.ch[at], s, len);
+	memset(&scr.back.fg[at], fg, len);
+	memset(&scr.back.attr[at], attr, len);
+	return x+len;
+}
+/* Fill back buffer line to the end.
+ */
+void screen_fill(int y, int x, int ch, int fg, int attr)
+{
+	size_t at = (size_t)y*scr.cols+x;
+	int len = scr.cols-x;
+	if(len <= 0) return;
+	memset(&scr.back.ch[at], ch, len);
+	memset(&scr.back.fg[at], fg, len);
+	memset(&scr.back.attr[at], attr, len);
+}
+/* Remember scroll of lines [top, bottom) by 'n' lines.
+ */
+void screen_scroll(int top, int bottom, int n)
+{
+	if(scr.scroll_n != 0 && (scr.scroll_top != top ||
+	    scr.scroll_bottom != bottom)) {
+		scr.full = 1;
+		return;
+	}
+	scr.scroll_top = top;
+	scr.scroll_bottom = bottom;
+	scr.scroll_n += n;
+}
+/* Compare back and front cell, colour does not matter on blank cells.
+ */
+static int cell_same(size_t i)
+{
+	return scr.back.ch[i] == scr.front.ch[i] &&
+		scr.back.attr[i] == scr.front.attr[i] &&
+		(scr.back.fg[i] == scr.front.fg[i] || scr.back.ch[i] == ' ');
+}
+/* Append cursor movement.
+ */
+static void emit_move(int y, int x)
+{
+	fb_append(&scr.out, "\x1b[", 2);
+	fb_num(&scr.out, y+1);
+	fb_append(&scr.out, ";", 1);
+	fb_num(&scr.out, x+1);
+	fb_append(&scr.out, "H", 1);
+}
+/* Switch graphic rendition, only sending what differs.
+ */
+static void emit_sgr(int fg, int attr)
+{
+	struct fbuf *fb = &scr.out;
+	int sep = 0;
+	if(scr.sgr_known && fg == scr.sgr_fg && attr == scr.sgr_attr) return;
+	fb_append(fb, "\x1b[", 2);
+	if(!scr.sgr_known) {
+		fb_append(fb, "0", 1);
+		sep = 1;
+		scr.sgr_fg = 0;
+		scr.sgr_attr = 0;
+	}
+	if((attr ^ scr.sgr_attr) & SCREEN_REVERSE) {
+		if(sep) fb_append(fb, ";", 1);
+		if(attr & SCREEN_REVERSE) fb_append(fb, "7", 1);
+		else fb_append(fb, "27", 2);
+		sep = 1;
+	}
+	if(fg != scr.sgr_fg) {
+		if(sep) fb_append(fb, ";", 1);
+		if(fg != 0) fb_num(fb, fg);
+		else fb_append(fb, "39", 2);
+	}
+	fb_append(fb, "m", 1);
+	scr.sgr_fg = fg;
+	scr.sgr_attr = attr;
+	scr.sgr_known = 1;
+}
+/* Blank front buffer lines [top, bottom).
+ */
+static void front_blank(int top, int bottom)
+{
+	size_t at = (size_t)top*scr.cols, n = (size_t)(bottom-top)*scr.cols;
+	memset(&scr.front.ch[at], ' ', n);
+	memset(&scr.front.fg[at], 0, n);
+	memset(&scr.front.attr[at], 0, n);
+}
+/* Move front buffer lines, used when the terminal scrolled.
+ */
+static void front_move(int to, int from, int lines)
+{
+	size_t n = (size_t)lines*scr.cols;
+	size_t t = (size_t)to*scr.cols, f = (size_t)from*scr.cols;
+	memmove(&scr.front.ch[t], &scr.front.ch[f], n);
+	memmove(&scr.front.fg[t], &scr.front.fg[f], n);
+	memmove(&scr.front.attr[t], &scr.front.attr[f], n);
+}
+/* Send scroll region operation and shift front buffer to match.
+ */
+static void flush_scroll(void)
+{
+	int top = scr.scroll_top, bottom = scr.scroll_bottom;
+	int n = scr.scroll_n, h = bottom-top;
+	scr.scroll_n = 0;
+	if(n == 0 || scr.full) return;
+	if(n >= h || -n >= h) {
+		scr.full = 1;
+		return;
+	}
+	/* new lines come in blank with the background of the rendition */
+	emit_sgr(scr.sgr_known ? scr.sgr_fg : 0, 0);
+	fb_append(&scr.out, "\x1b[", 2);
+	fb_num(&scr.out, top+1);
+	fb_append(&scr.out, ";", 1);
+	fb_num(&scr.out, bottom);
+	fb_append(&scr.out, "r\x1b[", 3);
+	fb_num(&scr.out, n > 0 ? n : -n);
+	fb_append(&scr.out, n > 0 ? "S" : "T", 1);
+	fb_append(&scr.out, "\x1b[r", 3);
+	if(n > 0) {
+		front_move(top, top+n, h-n);
+		front_blank(bottom-n, bottom);
+	} else {
+		front_move(top-n, top, h+n);
+		front_blank(top, top-n);
+	}
+}
+/* Send one changed span of cells in as few runs as possible.
+ */
+static void flush_span(size_t at, int len)
+{
+	const char *ch = &scr.back.ch[at];
+	const unsigned char *fg = &scr.back.fg[at];
+	const unsigned char *attr = &scr.back.attr[at];
+	int k = 0;
+	while(k < len) {
+		int r = k+1;
+		int f = (ch[k] == ' ' && scr.sgr_known) ? scr.sgr_fg : fg[k];
+		/* blanks join any run, their colour is never seen */
+		while(r < len && attr[r] == attr[k] &&
+		    (fg[r] == f || ch[r] == ' '))
+			r++;
+		emit_sgr(f, attr[k]);
+		fb_append(&scr.out, &ch[k], r-k);
+		k = r;
+	}
+}
+/* Send changed spans of screen to terminal.
+ */
+size_t screen_flush(int cy, int cx)
+{
+	int y, cur_y = -1, cur_x = -1;
+	scr.out.len = 0;
+	fb_append(&scr.out, "\x1b[?25l", 6);
+	flush_scroll();
+	if(scr.full) {
+		scr.sgr_known = 0;
+		emit_sgr(0, 0);
+		fb_append(&scr.out, "\x1b[2J", 4);
+		front_blank(0, scr.rows);
+		scr.full = 0;
+	}
+	for(y = 0; y < scr.rows; y++) {
+		size_t row = (size_t)y*scr.cols;
+		int x = 0;
+		while(x < scr.cols) {
+			int end, k, blank = 1;
+			if(cell_same(row+x)) {
+				x++;
+				continue;
+			}
+			/* find end of changed span, bridging small gaps */
+			for(end = k = x; k < scr.cols; k++) {
+				if(!cell_same(row+k)) end = k+1;
+				else if(k-end >= SCREEN_GAP) break;
+			}
+			/* blank rest of the line is cheaper to erase */
+			for(k = x; k < scr.cols && blank; k++)
+				blank = (scr.back.ch[row+k] == ' ' &&
+					scr.back.attr[row+k] == 0);
+			if(cur_y != y || cur_x != x) emit_move(y, x);
+			if(blank) {
+				emit_sgr(scr.sgr_known ? scr.sgr_fg : 0, 0);
+				fb_append(&scr.out, "\x1b[K", 3);
+				end = scr.cols;
+			} else {
+				flush_span(row+x, end-x);
+			}
+			memcpy(&scr.front.ch[row+x], &scr.back.ch[row+x], end-x);
+			memcpy(&scr.front.fg[row+x], &scr.back.fg[row+x], end-x);
+			memcpy(&scr.front.attr[row+x], &scr.back.attr[row+x],
+				end-x);
+			/* cursor wraps in odd ways after the last column */
+			cur_y = (end < scr.cols || blank) ? y : -1;
+			cur_x = blank ? x : end;
+			x = end;
+		}
+	}
+	emit_move(cy, cx);
+	fb_append(&scr.out, "\x1b[?25h", 6);
+	if(scr.sink != NULL) scr.sink(scr.out.b, scr.out.len);
+	else write(STDOUT_FILENO, scr.out.b, scr.out.len);
+	scr.st.frames++;
+	scr.st.last = scr.out.len;
+	scr.st.total += scr.out.len;
+	return scr.st.last;
+}
+/* Get output statistics.
+ */
+void screen_get_stats(struct screen_stats *st)
+{
+	*st = scr.st;
+}
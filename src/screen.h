@@ -0,0 +1,43 @@
+/**
+ * @file screen.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Terminal screen model with differential refresh.
+ ********************************************************************
+ */
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stddef.h>
+
+/* Cell attribute flags */
+#define SCREEN_REVERSE 1
+
+/* Screen output statistics */
+struct screen_stats {
+	unsigned long frames;
+	size_t last;
+	size_t total;
+};
+
+/* Send output to 'fn' instead of standard output (NULL for that). */
+void screen_output(void (*fn)(const char *s, size_t len));
+/* Resize screen, next flush redraws everything. */
+void screen_resize(int rows, int cols);
+/* Free screen buffers. */
+void screen_free(void);
+/* Forget what the terminal shows, next flush redraws everything. */
+void screen_invalidate(void);
+/* Put text into back buffer line, return column after it. */
+int screen_text(int y, int x, const char *s, int len, int fg, int attr);
+/* Fill back buffer line from column 'x' to the end. */
+void screen_fill(int y, int x, int ch, int fg, int attr);
+/* Note that lines [top, bottom) moved up by 'n' lines (down if negative). */
+void screen_scroll(int top, int bottom, int n);
+/* Send changes to terminal, leave cursor at (y, x), return bytes sent. */
+size_t screen_flush(int y, int x);
+/* Get output statistics. */
+void screen_get_stats(struct screen_stats *st);
+
+#endif
@@ -0,0 +1,292 @@
+/**
+ * @file search.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Vectorized substring search for PRS Edit.
+ *
+ * Candidates are found by comparing a whole block of the text with the
+ * first pattern byte and the block shifted by the pattern length less
+ * one with the last pattern byte; only positions where both agree are
+ * compared in full. Case folding is an OR with 0x20 when the pattern
+ * byte is a letter, whole word search drops candidates with a word
+ * character on either side before they are compared. Text left over at
+ * the end (and everything without SSE2) goes through Horspool.
+ ************************************************************************
+ */
+
+#if defined(__FreeBSD__) || defined(__OpenBSD__)
+#define _BSD_SOURCE
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEARCH_X86
+#endif
+
+#include "search.h"
+
+/* ASCII lower case of byte */
+#define FOLD(c) ((c) >= 'A' && (c) <= 'Z' ? (c)|0x20 : (c))
+/* Byte belongs to a word */
+#define WORDCH(c) ((((c)|0x20) >= 'a' && ((c)|0x20) <= 'z') || \
+	((c) >= '0' && (c) <= '9') || (c) == '_')
+
+/* Compare pattern with text at 'i', checking word edges if asked for.
+ */
+static int match_at(const finder *f, const unsigned char *s, size_t len,
+	size_t i)
+{
+	const unsigned char *p = s+i;
+	size_t k;
+	if(f->flags & SEARCH_ICASE) {
+		for(k = 0; k < f->len; k++)
+			if(FOLD(p[k]) != f->pat[k]) return 0;
+	} else if(memcmp(p, f->pat, f->len) != 0) {
+		return 0;
+	}
+	if(f->flags & SEARCH_WORD) {
+		if(i > 0 && WORDCH(s[i-1])) return 0;
+		if(i+f->len < len && WORDCH(s[i+f->len])) return 0;
+	}
+	return 1;
+}
+/* Horspool search from 'i'.
+ */
+static const char *find_scalar(const finder *f, const unsigned char *s,
+	size_t len, size_t i)
+{
+	size_t n = f->len;
+	unsigned char last = f->pat[n-1];
+	while(i+n <= len) {
+		unsigned char c = s[i+n-1];
+		if(f->flags & SEARCH_ICASE) c = FOLD(c);
+		if(c == last && match_at(f, s, len, i))
+			return (const char*)s+i;
+		i += f->skip[c];
+	}
+	return NULL;
+}
+/* Case fold mask for pattern byte, only letters are folded.
+ */
+static int fold_bit(const finder *f, unsigned char c)
+{
+	return ((f->flags & SEARCH_ICASE) && c >= 'a' && c <= 'z') ? 0x20 : 0;
+}
+#ifdef SEARCH_X86
+/* Word characters of sixteen bytes.
+ */
+static __m128i word_sse2(__m128i v)
+{
+	__m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i a = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a'-1)),
+		_mm_cmpgt_epi8(_mm_set1_epi8('z'+1), l));
+	__m128i d = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0'-1)),
+		_mm_cmpgt_epi8(_mm_set1_epi8('9'+1), v));
+	return _mm_or_si128(_mm_or_si128(a, d),
+		_mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+/* Filter candidates sixteen bytes at a time.
+ */
+static const char *find_sse2(const finder *f, const unsigned char *s,
+	size_t len, size_t i)
+{
+	size_t n = f->len;
+	__m128i c0 = _mm_set1_epi8(f->pat[0]);
+	__m128i c1 = _mm_set1_epi8(f->pat[n-1]);
+	__m128i f0 = _mm_set1_epi8(fold_bit(f, f->pat[0]));
+	__m128i f1 = _mm_set1_epi8(fold_bit(f, f->pat[n-1]));
+	int word = f->flags & SEARCH_WORD;
+	if(word && i == 0) {
+		if(n <= len && match_at(f, s, len, 0)) return (const char*)s;
+		i = 1;
+	}
+	for(; i+n+16 <= len; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(s+i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(s+i+n-1));
+		__m128i m = _mm_and_si128(
+			_mm_cmpeq_epi8(_mm_or_si128(a, f0), c0),
+			_mm_cmpeq_epi8(_mm_or_si128(b, f1), c1));
+		unsigned int bits;
+		if(word) {
+			__m128i pre = _mm_loadu_si128((const __m128i*)(s+i-1));
+			__m128i post = _mm_loadu_si128((const __m128i*)(s+i+n));
+			m = _mm_andnot_si128(word_sse2(pre), m);
+			m = _mm_andnot_si128(word_sse2(post), m);
+		}
+		bits = _mm_movemask_epi8(m);
+		while(bits != 0) {
+			size_t at = i+__builtin_ctz(bits);
+			if(match_at(f, s, len, at)) return (const char*)s+at;
+			bits &= bits-1;
+		}
+	}
+	return find_scalar(f, s, len, i);
+}
+/* Word characters of thirty two bytes.
+ */
+__attribute__((target("avx2")))
+static __m256i word_avx2(__m256i v)
+{
+	__m256i l = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	__m256i a = _mm256_and_si256(
+		_mm256_cmpgt_epi8(l, _mm256_set1_epi8('a'-1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('z'+1), l));
+	__m256i d = _mm256_and_si256(
+		_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0'-1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('9'+1), v));
+	return _mm256_or_si256(_mm256_or_si256(a, d),
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+/* Filter candidates thirty two bytes at a time.
+ */
+__attribute__((target("avx2")))
+static const char *find_avx2(const finder *f, const unsigned char *s,
+	size_t len, size_t i)
+{
+	size_t n = f->len;
+	__m256i c0 = _mm256_set1_epi8(f->pat[0]);
+	__m256i c1 = _mm256_set1_epi8(f->pat[n-1]);
+	__m256i f0 = _mm256_set1_epi8(fold_bit(f, f->pat[0]));
+	__m256i f1 = _mm256_set1_epi8(fold_bit(f, f->pat[n-1]));
+	int word = f->flags & SEARCH_WORD;
+	if(word && i == 0) {
+		if(n <= len && match_at(f, s, len, 0)) return (const char*)s;
+		i = 1;
+	}
+	for(; i+n+32 <= len; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(s+i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(s+i+n-1));
+		__m256i m = _mm256_and_si256(
+			_mm256_cmpeq_epi8(_mm256_or_si256(a, f0), c0),
+			_mm256_cmpeq_epi8(_mm256_or_si256(b, f1), c1));
+		unsigned int bits;
+		if(word) {
+			__m256i pre = _mm256_loadu_si256(
+				(const __m256i*)(s+i-1));
+			__m256i post = _mm256_loadu_si256(
+				(const __m256i*)(s+i+n));
+			m = _mm256_andnot_si256(word_avx2(pre), m);
+			m = _mm256_andnot_si256(word_avx2(post), m);
+		}
+		bits = _mm256_movemask_epi8(m);
+		while(bits != 0) {
+			size_t at = i+__builtin_ctz(bits);
+			if(match_at(f, s, len, at)) return (const char*)s+at;
+			bits &= bits-1;
+		}
+	}
+	return find_scalar(f, s, len, i);
+}
+#endif
+/* Fastest kernel the running CPU supports.
+ */
+int search_best_kernel(void)
+{
+#ifdef SEARCH_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) return SEARCH_AVX2;
+	if(__builtin_cpu_supports("sse2")) return SEARCH_SSE2;
+#endif
+	return SEARCH_SCALAR;
+}
+/* Name of candidate filter kernel.
+ */
+const char *search_kernel_name(int kernel)
+{
+	switch(kernel) {
+	case SEARCH_SCALAR: return "scalar";
+	case SEARCH_SSE2: return "sse2";
+	case SEARCH_AVX2: return "avx2";
+	default: return "auto";
+	}
+}
+/* Compile pattern with options.
+ */
+int search_compile(finder *f, const char *pat, size_t len, int flags)
+{
+	size_t i;
+	memset(f, 0, sizeof(finder));
+	f->pat = malloc(len+1);
+	if(f->pat == NULL) return -1;
+	f->len = len;
+	f->flags = flags;
+	for(i = 0; i < len; i++) {
+		unsigned char c = pat[i];
+		f->pat[i] = (flags & SEARCH_ICASE) ? FOLD(c) : c;
+	}
+	f->pat[len] = '\0';
+	/* Horspool shifts keyed by the (folded) byte under the last one */
+	for(i = 0; i < 256; i++)
+		f->skip[i] = len;
+	for(i = 0; i+1 < len; i++)
+		f->skip[f->pat[i]] = len-1-i;
+	search_set_kernel(f, SEARCH_AUTO);
+	return 0;
+}
+/* Force candidate filter kernel.
+ */
+void search_set_kernel(finder *f, int kernel)
+{
+	static int best = SEARCH_AUTO;
+	if(kernel == SEARCH_AUTO) {
+		if(best == SEARCH_AUTO) best = search_best_kernel();
+		kernel = best;
+	}
+#ifndef SEARCH_X86
+	kernel = SEARCH_SCALAR;
+#endif
+	f->kernel = kernel;
+}
+/* Find first match at or after offset.
+ */
+const char *search_find_from(const finder *f, const char *s, size_t len,
+	size_t from)
+{
+	const unsigned char *u = (const unsigned char*)s;
+	if(f->len == 0 || from > len || len-from < f->len) return NULL;
+	switch(f->kernel) {
+#ifdef SEARCH_X86
+	case SEARCH_AVX2: return find_avx2(f, u, len, from);
+	case SEARCH_SSE2: return find_sse2(f, u, len, from);
+#endif
+	default: return find_scalar(f, u, len, from);
+	}
+}
+/* Find first match.
+ */
+const char *search_find(const finder *f, const char *s, size_t len)
+{
+	return search_find_from(f, s, len, 0);
+}
+/* Check for a match at offset.
+ */
+int search_match_at(const finder *f, const char *s, size_t len, size_t at)
+{
+	if(f->len == 0 || at > len || len-at < f->len) return 0;
+	return match_at(f, (const unsigned char*)s, len, at);
+}
+/* Find last match.
+ */
+const char *search_find_last(const finder *f, const char *s, size_t len)
+{
+	const char *p, *last = NULL;
+	size_t at = 0;
+	while((p = search_find_from(f, s, len, at)) != NULL) {
+		last = p;
+		at = p-s+1;
+	}
+	return last;
+}
+/* Free compiled pattern.
+ */
+void search_free(finder *f)
+{
+	free(f->pat);
+	f->pat = NULL;
+	f->len = 0;
+}
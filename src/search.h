@@ -0,0 +1,55 @@
+/**
+ * @file search.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Vectorized substring search for raw text and file mappings.
+ ********************************************************************
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+
+/* Search options */
+#define SEARCH_ICASE (1<<0)
+#define SEARCH_WORD (1<<1)
+#define SEARCH_REGEX (1<<2)	/* pattern is for dfa.c */
+
+/* Candidate filter kernels */
+enum search_kernel {
+	SEARCH_AUTO = 0,
+	SEARCH_SCALAR,
+	SEARCH_SSE2,
+	SEARCH_AVX2
+};
+/* Compiled search pattern, folded to lower case for SEARCH_ICASE */
+typedef struct finder {
+	unsigned char *pat;
+	size_t len;
+	int flags;
+	int kernel;
+	size_t skip[256];
+} finder;
+
+/* Compile pattern with options using the best kernel. */
+int search_compile(finder *f, const char *pat, size_t len, int flags);
+/* Force candidate filter kernel of compiled pattern. */
+void search_set_kernel(finder *f, int kernel);
+/* Find first match in text, NULL if none (empty patterns never match). */
+const char *search_find(const finder *f, const char *s, size_t len);
+/* Find first match at or after offset 'from', word edges see all of 's'. */
+const char *search_find_from(const finder *f, const char *s, size_t len,
+	size_t from);
+/* Check for a match at offset 'at' of text. */
+int search_match_at(const finder *f, const char *s, size_t len, size_t at);
+/* Find last match in text, NULL if none. */
+const char *search_find_last(const finder *f, const char *s, size_t len);
+/* Fastest kernel the running CPU supports. */
+int search_best_kernel(void);
+/* Name of candidate filter kernel. */
+const char *search_kernel_name(int kernel);
+/* Free compiled pattern. */
+void search_free(finder *f);
+
+#endif
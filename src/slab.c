@@ -0,0 +1,177 @@
+/**
+ * @file slab.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Size classed slab allocator for PRS Edit.
+ *
+ * Small blocks are cut from large chunks, the size classes step by
+ * powers of two with a half step in between so rounding wastes at most
+ * a third. Freed blocks go on a free list for their class, callers pass
+ * the block size back so no per block header is needed. Blocks larger
+ * than SLAB_MAX come from malloc with a small header that chains them to
+ * the slab. Freeing a whole buffer only walks the chunks, never rows.
+ ************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+
+/* Header of a chunk or of a block larger than SLAB_MAX */
+struct slab_link {
+	struct slab_link *next;
+	struct slab_link *prev;
+};
+
+/* Block sizes of every class */
+static const size_t slab_sizes[SLAB_CLASSES] = {
+	16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768,
+	1024, 1536, 2048, 3072, 4096
+};
+
+/* Find size class for block of 'n' bytes.
+ */
+static int slab_class(size_t n)
+{
+	int c = 0;
+	while(slab_sizes[c] < n) c++;
+	return c;
+}
+/* Initialise an empty slab.
+ */
+void slab_init(slab *s)
+{
+	memset(s, 0, sizeof(slab));
+}
+/* Release every chunk and large block.
+ */
+void slab_free_all(slab *s)
+{
+	struct slab_link *l = (struct slab_link*)s->chunk;
+	while(l != NULL) {
+		struct slab_link *next = l->next;
+		free(l);
+		l = next;
+	}
+	l = s->big;
+	while(l != NULL) {
+		struct slab_link *next = l->next;
+		free(l);
+		l = next;
+	}
+	slab_init(s);
+}
+/* Size handed out for request.
+ */
+size_t slab_round(size_t n)
+{
+	return n <= SLAB_MAX ? slab_sizes[slab_class(n)] : n;
+}
+/* Allocate block from slab.
+ */
+void *slab_alloc(slab *s, size_t n)
+{
+	struct slab_link *l;
+	size_t size;
+	int c;
+	if(n > SLAB_MAX) {
+		l = malloc(sizeof(struct slab_link)+n);
+		if(l == NULL) return NULL;
+		l->prev = NULL;
+		l->next = s->big;
+		if(s->big != NULL) ((struct slab_link*)s->big)->prev = l;
+		s->big = l;
+		s->used += n;
+		s->reserved += sizeof(struct slab_link)+n;
+		return l+1;
+	}
+	c = slab_class(n);
+	size = slab_sizes[c];
+	s->used += n;
+	if(s->free[c] != NULL) {
+		void *p = s->free[c];
+		s->free[c] = *(void**)p;
+		return p;
+	}
+	if(s->chunk == NULL || s->chunk_used+size > SLAB_CHUNK) {
+		/* the tail of the old chunk is simply left over */
+		l = malloc(SLAB_CHUNK);
+		if(l == NULL) {
+			s->used -= n;
+			return NULL;
+		}
+		l->next = (struct slab_link*)s->chunk;
+		l->prev = NULL;
+		s->chunk = (char*)l;
+		s->chunk_used = sizeof(struct slab_link);
+		s->reserved += SLAB_CHUNK;
+	}
+	s->chunk_used += size;
+	return s->chunk+s->chunk_used-size;
+}
+/* Allocate zeroed block from slab.
+ */
+void *slab_calloc(slab *s, size_t n)
+{
+	void *p = slab_alloc(s, n);
+	if(p != NULL) memset(p, 0, n);
+	return p;
+}
+/* Return block to slab.
+ */
+void slab_free(slab *s, void *p, size_t n)
+{
+	int c;
+	if(p == NULL) return;
+	if(n > SLAB_MAX) {
+		struct slab_link *l = (struct slab_link*)p-1;
+		if(l->prev != NULL) l->prev->next = l->next;
+		else s->big = l->next;
+		if(l->next != NULL) l->next->prev = l->prev;
+		s->used -= n;
+		s->reserved -= sizeof(struct slab_link)+n;
+		free(l);
+		return;
+	}
+	c = slab_class(n);
+	*(void**)p = s->free[c];
+	s->free[c] = p;
+	s->used -= n;
+}
+/* Resize block, stays in place while it fits its size class.
+ */
+void *slab_realloc(slab *s, void *p, size_t old, size_t n)
+{
+	void *q;
+	if(p == NULL) return slab_alloc(s, n);
+	if(old <= SLAB_MAX && n <= SLAB_MAX &&
+	    slab_class(old) == slab_class(n)) {
+		s->used += n-old;
+		return p;
+	}
+	if(old > SLAB_MAX && n > SLAB_MAX) {
+		struct slab_link *l = (struct slab_link*)p-1;
+		l = realloc(l, sizeof(struct slab_link)+n);
+		if(l == NULL) return NULL;
+		if(l->prev != NULL) l->prev->next = l;
+		else s->big = l;
+		if(l->next != NULL) l->next->prev = l;
+		s->used += n-old;
+		s->reserved += n-old;
+		return l+1;
+	}
+	q = slab_alloc(s, n);
+	if(q == NULL) return NULL;
+	memcpy(q, p, old < n ? old : n);
+	slab_free(s, p, old);
+	return q;
+}
+/* Get slab statistics.
+ */
+void slab_get_stats(const slab *s, struct slab_stats *st)
+{
+	st->used = s->used;
+	st->reserved = s->reserved;
+	st->wasted = s->reserved-s->used;
+}
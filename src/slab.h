@@ -0,0 +1,54 @@
+/**
+ * @file slab.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Size classed slab allocator for per buffer storage.
+ ********************************************************************
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/* Largest block served from slab chunks, bigger ones use malloc */
+#define SLAB_MAX 4096
+/* Bytes carved out of the system allocator at a time */
+#define SLAB_CHUNK (256*1024)
+/* Number of size classes up to SLAB_MAX */
+#define SLAB_CLASSES 17
+
+/* Slab allocator statistics */
+struct slab_stats {
+	size_t used;
+	size_t wasted;
+	size_t reserved;
+};
+/* Slab allocator structure, everything in it is released at once */
+typedef struct slab {
+	char *chunk;
+	size_t chunk_used;
+	void *free[SLAB_CLASSES];
+	void *big;
+	size_t used;
+	size_t reserved;
+} slab;
+
+/* Initialise an empty slab. */
+void slab_init(slab *s);
+/* Release every block of the slab at once. */
+void slab_free_all(slab *s);
+/* Size actually handed out for a request of 'n' bytes. */
+size_t slab_round(size_t n);
+/* Allocate 'n' bytes. */
+void *slab_alloc(slab *s, size_t n);
+/* Allocate 'n' zeroed bytes. */
+void *slab_calloc(slab *s, size_t n);
+/* Return block of 'n' bytes to the slab. */
+void slab_free(slab *s, void *p, size_t n);
+/* Resize block of 'old' bytes to 'n' bytes. */
+void *slab_realloc(slab *s, void *p, size_t old, size_t n);
+/* Get bytes requested by live blocks and bytes reserved but not used. */
+void slab_get_stats(const slab *s, struct slab_stats *st);
+
+#endif
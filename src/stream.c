@@ -0,0 +1,743 @@
+/**
+ * @file stream.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Non-interactive stream editing for PRS Edit.
+ *
+ * A script of sed like commands runs over text that streams through a
+ * read-ahead buffer and a write-behind buffer, so memory stays bounded by
+ * the buffers and the longest line however big the input is. The whole
+ * buffer is searched for the patterns of the script with the vectorized
+ * search kernels first, and runs of lines no command can touch are
+ * copied out in one go. Only lines holding a match, or addressed by line
+ * number, are taken apart.
+ *
+ * Script:	[address]command, separated by new lines or ';'
+ * Address:	N (line number), $ (last line), /pattern/
+ * Commands:	d (delete line), p (print line), s/pattern/text/[g]
+ *		(replace, & is the match), i text (insert line before),
+ *		a text (append line after)
+ ************************************************************************
+ */
+
+#if defined(__FreeBSD__) || defined(__OpenBSD__)
+#define _BSD_SOURCE
+#else
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "search.h"
+#include "dfa.h"
+#include "lineidx.h"
+#include "stream.h"
+
+/* Bytes of lines counted at once while looking for a line number */
+#define STREAM_SKIP (64*1024)
+
+/* Script commands */
+enum stream_op {
+	STREAM_DELETE,
+	STREAM_PRINT,
+	STREAM_SUBST,
+	STREAM_INSERT,
+	STREAM_APPEND
+};
+/* Lines a command applies to */
+enum stream_addr {
+	ADDR_ALL,
+	ADDR_LINE,
+	ADDR_LAST,
+	ADDR_MATCH
+};
+/* Compiled pattern, 're' is set for regular expressions */
+struct spat {
+	finder f;
+	dfa *re;
+};
+/* Script command */
+struct scmd {
+	int op;
+	int addr;
+	unsigned long line;
+	struct spat at;
+	struct spat pat;
+	char *text;
+	size_t text_len;
+	int global;
+	size_t hit;
+	int hit_ok;
+};
+/* Growable byte buffer */
+struct sbuf {
+	char *b;
+	size_t len, cap;
+};
+/* Compiled script and stream state */
+struct stream {
+	struct scmd *cmd;
+	int n, cap;
+	int flags;
+	int lines;
+	int last;
+	unsigned long lineno;
+	struct sbuf in;
+	struct sbuf out;
+	struct sbuf line;
+	struct sbuf tmp;
+	size_t *m;
+	size_t m_n, m_cap;
+	struct scmd **app;
+	int fd;
+	int err;
+	int owe;
+	int added;
+};
+
+/* Make room for 'len' more bytes in buffer.
+ */
+static void sbuf_reserve(struct sbuf *b, size_t len)
+{
+	if(b->cap-b->len < len) {
+		size_t cap = b->cap > 0 ? b->cap*2 : 256;
+		while(cap < b->len+len) cap *= 2;
+		b->b = realloc(b->b, cap);
+		b->cap = cap;
+	}
+}
+/* Append bytes to buffer.
+ */
+static void sbuf_add(struct sbuf *b, const char *s, size_t len)
+{
+	sbuf_reserve(b, len);
+	memcpy(&b->b[b->len], s, len);
+	b->len += len;
+}
+/* Write all of 's' to the output, remembering the first error.
+ */
+static void stream_write(stream *st, const char *s, size_t len)
+{
+	size_t done = 0;
+	while(done < len && !st->err) {
+		ssize_t w = write(st->fd, s+done, len-done);
+		if(w < 0 && errno == EINTR) continue;
+		if(w <= 0) st->err = w < 0 ? errno : EIO;
+		else done += w;
+	}
+}
+/* Write everything waiting in the write-behind buffer.
+ */
+static void stream_flush(stream *st)
+{
+	stream_write(st, st->out.b, st->out.len);
+	st->out.len = 0;
+}
+/* Queue output, big runs go straight out.
+ */
+static void stream_put(stream *st, const char *s, size_t len)
+{
+	if(st->out.cap-st->out.len < len) {
+		stream_flush(st);
+		if(len >= st->out.cap) {
+			stream_write(st, s, len);
+			return;
+		}
+	}
+	memcpy(&st->out.b[st->out.len], s, len);
+	st->out.len += len;
+}
+/* Queue line of output, a line that lacked its new line gets one when
+ * more lines follow it.
+ */
+static void stream_put_line(stream *st, const char *s, size_t len, int nl)
+{
+	if(st->owe) stream_put(st, "\n", 1);
+	stream_put(st, s, len);
+	if(nl) stream_put(st, "\n", 1);
+	st->owe = !nl;
+}
+/* Keep match of pattern as offset and length pair.
+ */
+static void stream_hit(void *arg, size_t at, size_t len)
+{
+	stream *st = arg;
+	if(st->m_n+2 > st->m_cap) {
+		st->m_cap = st->m_cap > 0 ? st->m_cap*2 : 64;
+		st->m = realloc(st->m, sizeof(size_t)*st->m_cap);
+	}
+	st->m[st->m_n++] = at;
+	st->m[st->m_n++] = len;
+}
+/* Gather matches of pattern in line, only the first one unless 'all' is
+ * set. Returns number of matches.
+ */
+static size_t stream_matches(stream *st, struct spat *p, const char *s,
+	size_t len, int all)
+{
+	const char *m;
+	size_t from = 0;
+	st->m_n = 0;
+	if(p->re != NULL) {
+		const finder *pre = dfa_prefilter(p->re);
+		if(pre == NULL || search_find(pre, s, len) != NULL)
+			dfa_find_all(p->re, s, len, stream_hit, st);
+		if(!all && st->m_n > 2) st->m_n = 2;
+		return st->m_n/2;
+	}
+	while((m = search_find_from(&p->f, s, len, from)) != NULL) {
+		stream_hit(st, m-s, p->f.len);
+		if(!all) break;
+		from = m-s+p->f.len;
+	}
+	return st->m_n/2;
+}
+/* Check if command applies to line.
+ */
+static int stream_addressed(stream *st, struct scmd *c, const char *s,
+	size_t len, int last)
+{
+	switch(c->addr) {
+	case ADDR_LINE: return st->lineno == c->line;
+	case ADDR_LAST: return last;
+	case ADDR_MATCH:
+		if(c->at.re == NULL) return search_find(&c->at.f, s, len) != NULL;
+		return stream_matches(st, &c->at, s, len, 0) > 0;
+	default: return 1;
+	}
+}
+/* Replace matches in line, returns nonzero when it changed.
+ */
+static int stream_subst(stream *st, struct scmd *c, const char **s,
+	size_t *len)
+{
+	struct sbuf t;
+	size_t i, at = 0, n = stream_matches(st, &c->pat, *s, *len, c->global);
+	if(n == 0) return 0;
+	st->tmp.len = 0;
+	for(i = 0; i < n; i++) {
+		size_t off = st->m[2*i], mlen = st->m[2*i+1], k;
+		sbuf_add(&st->tmp, *s+at, off-at);
+		for(k = 0; k < c->text_len; k++) {
+			char ch = c->text[k];
+			if(ch == '&') {
+				sbuf_add(&st->tmp, *s+off, mlen);
+				continue;
+			}
+			if(ch == '\\' && k+1 < c->text_len) {
+				ch = c->text[++k];
+				if(ch == 'n') ch = '\n';
+				else if(ch == 't') ch = '\t';
+			}
+			sbuf_add(&st->tmp, &ch, 1);
+		}
+		at = off+mlen;
+	}
+	sbuf_add(&st->tmp, *s+at, *len-at);
+	/* the line becomes the new text, the old one is scratch space */
+	t = st->line;
+	st->line = st->tmp;
+	st->tmp = t;
+	*s = st->line.b;
+	*len = st->line.len;
+	return 1;
+}
+/* Run script over one line, 'nl' is set when a new line ended it.
+ */
+static void stream_line(stream *st, const char *s, size_t len, int nl,
+	int last)
+{
+	int i, napp = 0, deleted = 0;
+	st->lineno++;
+	for(i = 0; i < st->n && !deleted; i++) {
+		struct scmd *c = &st->cmd[i];
+		if(!stream_addressed(st, c, s, len, last)) continue;
+		switch(c->op) {
+		case STREAM_DELETE:
+			deleted = 1;
+		break;
+		case STREAM_PRINT:
+			stream_put_line(st, s, len, nl);
+		break;
+		case STREAM_SUBST:
+			stream_subst(st, c, &s, &len);
+		break;
+		case STREAM_INSERT:
+			stream_put_line(st, c->text, c->text_len, 1);
+		break;
+		case STREAM_APPEND:
+			st->app[napp++] = c;
+		break;
+		}
+	}
+	if(!deleted && !(st->flags & STREAM_QUIET))
+		stream_put_line(st, s, len, nl);
+	for(i = 0; i < napp; i++)
+		stream_put_line(st, st->app[i]->text, st->app[i]->text_len, 1);
+}
+/* Start of the first line at or after 'p' that command 'c' may touch,
+ * 'end' if none in the block.
+ */
+static size_t stream_next_cmd(stream *st, struct scmd *c, const char *b,
+	size_t p, size_t end, size_t last)
+{
+	struct spat *sp = NULL;
+	const finder *f;
+	const char *m, *nl;
+	switch(c->addr) {
+	case ADDR_LINE:
+		if(st->lineno >= c->line) return end;
+		if(!c->hit_ok || c->hit < p) {
+			/* skip whole runs of lines before it, then find it a
+			 * new line at a time in the run it is in */
+			unsigned long k = c->line-st->lineno-1;
+			const char *s = b+p;
+			while(k > 0 && s < b+end) {
+				size_t n = b+end-s < STREAM_SKIP ? b+end-s : STREAM_SKIP;
+				size_t cnt = lineidx_count(s, n);
+				if(cnt < k) {
+					k -= cnt;
+					s += n;
+					continue;
+				}
+				for(; k > 0; k--)
+					s = (const char *)memchr(s, '\n', b+end-s)+1;
+			}
+			c->hit = k > 0 ? end : (size_t)(s-b);
+			c->hit_ok = 1;
+		}
+		return c->hit;
+	case ADDR_LAST: return last;
+	case ADDR_MATCH: sp = &c->at; break;
+	default: if(c->op == STREAM_SUBST) sp = &c->pat; break;
+	}
+	if(sp == NULL) return p;
+	f = sp->re != NULL ? dfa_prefilter(sp->re) : &sp->f;
+	if(f == NULL) return p;
+	if(!c->hit_ok || c->hit < p) {
+		m = search_find_from(f, b, end, p);
+		c->hit = m != NULL ? (size_t)(m-b) : end;
+		c->hit_ok = 1;
+	}
+	if(c->hit >= end) return end;
+	nl = c->hit > p ? memrchr(b+p, '\n', c->hit-p) : NULL;
+	return nl != NULL ? (size_t)(nl+1-b) : p;
+}
+/* Run script over block of whole lines, 'last' is the start of the last
+ * line of the input or 'end' when it is not in the block.
+ */
+static void stream_block(stream *st, const char *b, size_t end, size_t last)
+{
+	size_t p = 0;
+	int i;
+	for(i = 0; i < st->n; i++)
+		st->cmd[i].hit_ok = 0;
+	while(p < end && !st->err) {
+		size_t q = end;
+		const char *nl;
+		for(i = 0; i < st->n && q > p; i++) {
+			size_t c = stream_next_cmd(st, &st->cmd[i], b, p, end, last);
+			if(c < q) q = c;
+		}
+		if(q > p) {
+			/* no command touches these lines */
+			if(!(st->flags & STREAM_QUIET)) {
+				if(st->owe) stream_put(st, "\n", 1);
+				stream_put(st, b+p, q-p);
+				st->owe = b[q-1] != '\n';
+			}
+			if(st->lines) {
+				st->lineno += lineidx_count(b+p, q-p);
+				/* the last line of an input may lack its new line */
+				if(b[q-1] != '\n') st->lineno++;
+			}
+			p = q;
+			continue;
+		}
+		nl = memchr(b+p, '\n', end-p);
+		if(nl == NULL) {
+			stream_line(st, b+p, end-p, 0, 1);
+			break;
+		}
+		stream_line(st, b+p, nl-(b+p), 1, p == last);
+		p = nl+1-b;
+	}
+}
+/* Fill read-ahead buffer, returns bytes read or -1 on error.
+ */
+static long stream_fill(stream *st, int in)
+{
+	long got = 0;
+	while(st->in.len < st->in.cap) {
+		ssize_t r = read(in, st->in.b+st->in.len, st->in.cap-st->in.len);
+		if(r < 0 && errno == EINTR) continue;
+		if(r < 0) return -1;
+		if(r == 0) break;
+		st->in.len += r;
+		got += r;
+	}
+	return got;
+}
+/* Run script over input.
+ */
+int stream_run(stream *st, int in, int out)
+{
+	int eof = 0;
+	st->fd = out;
+	st->err = 0;
+	while(!eof && !st->err) {
+		size_t end;
+		long got = stream_fill(st, in);
+		const char *nl;
+		if(got < 0) return -1;
+		if(got > 0) st->added = 0;
+		eof = got == 0 || st->in.len < st->in.cap;
+		if(st->in.len == 0) break;
+		nl = memrchr(st->in.b, '\n', st->in.len);
+		end = nl != NULL ? (size_t)(nl+1-st->in.b) : 0;
+		if(eof && end < st->in.len) {
+			/* the last line lacks its new line, it gets one if the
+			 * next input brings more lines */
+			if(st->last) {
+				sbuf_add(&st->in, "\n", 1);
+				st->added = 1;
+			}
+			end = st->in.len;
+		}
+		/* the last line of the stream is only known once every input
+		 * is read, stream_finish() runs it */
+		if(st->last && end > 0) {
+			nl = memrchr(st->in.b, '\n', end-1);
+			end = nl != NULL ? (size_t)(nl+1-st->in.b) : 0;
+		}
+		if(end == 0) {
+			if(eof) break;
+			/* a line longer than the buffer grows it */
+			sbuf_reserve(&st->in, st->in.cap);
+			continue;
+		}
+		stream_block(st, st->in.b, end, end);
+		memmove(st->in.b, st->in.b+end, st->in.len-end);
+		st->in.len -= end;
+	}
+	stream_flush(st);
+	if(st->err) {
+		errno = st->err;
+		return -1;
+	}
+	return 0;
+}
+/* Run script over the last line held back and end the stream.
+ */
+int stream_finish(stream *st)
+{
+	st->err = 0;
+	if(st->in.len > 0) {
+		if(st->added) st->in.len--;
+		stream_block(st, st->in.b, st->in.len, 0);
+	}
+	stream_flush(st);
+	st->in.len = 0;
+	st->added = 0;
+	st->owe = 0;
+	st->lineno = 0;
+	if(st->err) {
+		errno = st->err;
+		return -1;
+	}
+	return 0;
+}
+/* Compile pattern.
+ */
+static int stream_pattern(struct spat *p, const char *s, size_t len,
+	int flags, const char **err)
+{
+	if(len == 0) {
+		*err = "empty pattern";
+		return -1;
+	}
+	flags &= SEARCH_ICASE | SEARCH_WORD | SEARCH_REGEX;
+	if(flags & SEARCH_REGEX) {
+		p->re = dfa_compile(s, len, flags & ~SEARCH_REGEX, err);
+		return p->re != NULL ? 0 : -1;
+	}
+	return search_compile(&p->f, s, len, flags);
+}
+/* Read delimited text of script into 'b', escaped delimiters lose their
+ * backslash. Literal patterns ('lit') also resolve \\, \t and \n.
+ */
+static const char *stream_delim(const char *s, const char *end, char d,
+	struct sbuf *b, int lit)
+{
+	b->len = 0;
+	while(s < end && *s != d && *s != '\n') {
+		if(*s == '\\' && s+1 < end) {
+			if(s[1] == d) {
+				sbuf_add(b, &d, 1);
+				s += 2;
+				continue;
+			}
+			if(lit) {
+				char c = s[1] == 't' ? '\t' : s[1] == 'n' ? '\n' : s[1];
+				sbuf_add(b, &c, 1);
+				s += 2;
+				continue;
+			}
+			sbuf_add(b, s++, 1);
+		}
+		sbuf_add(b, s++, 1);
+	}
+	return (s < end && *s == d) ? s+1 : NULL;
+}
+/* Compile one command, returns where the next one starts.
+ */
+static const char *stream_command(stream *st, const char *s, const char *end,
+	struct sbuf *b, const char **err)
+{
+	int lit = !(st->flags & SEARCH_REGEX);
+	struct scmd *c;
+	const char *t;
+	if(st->n == st->cap) {
+		st->cap = st->cap > 0 ? st->cap*2 : 8;
+		st->cmd = realloc(st->cmd, sizeof(struct scmd)*st->cap);
+	}
+	c = &st->cmd[st->n++];
+	memset(c, 0, sizeof(struct scmd));
+	/* address */
+	if(*s >= '0' && *s <= '9') {
+		c->addr = ADDR_LINE;
+		while(s < end && *s >= '0' && *s <= '9')
+			c->line = c->line*10+(*s++-'0');
+		st->lines = 1;
+	} else if(*s == '$') {
+		c->addr = ADDR_LAST;
+		st->last = 1;
+		s++;
+	} else if(*s == '/') {
+		c->addr = ADDR_MATCH;
+		if((s = stream_delim(s+1, end, '/', b, lit)) == NULL) {
+			*err = "unterminated address";
+			return NULL;
+		}
+		if(stream_pattern(&c->at, b->b, b->len, st->flags, err) < 0)
+			return NULL;
+	}
+	while(s < end && (*s == ' ' || *s == '\t'))
+		s++;
+	if(s == end) {
+		*err = "missing command";
+		return NULL;
+	}
+	switch(*s++) {
+	case 'd': c->op = STREAM_DELETE; break;
+	case 'p': c->op = STREAM_PRINT; break;
+	case 'i':
+	case 'a':
+		c->op = s[-1] == 'i' ? STREAM_INSERT : STREAM_APPEND;
+		/* text runs to the end of the line, sed's 'i\' works too */
+		if(s < end && *s == '\\') s++;
+		if(s < end && *s == '\n') s++;
+		while(s < end && (*s == ' ' || *s == '\t'))
+			s++;
+		for(t = s; t < end && *t != '\n'; t++)
+			;
+		c->text = malloc(t-s+1);
+		memcpy(c->text, s, t-s);
+		c->text_len = t-s;
+		return t;
+	case 's': {
+		char d;
+		if(s == end || *s == '\\' || *s == '\n') {
+			*err = "bad delimiter of 's' command";
+			return NULL;
+		}
+		c->op = STREAM_SUBST;
+		d = *s++;
+		if((s = stream_delim(s, end, d, b, lit)) == NULL) {
+			*err = "unterminated 's' command";
+			return NULL;
+		}
+		if(stream_pattern(&c->pat, b->b, b->len, st->flags, err) < 0)
+			return NULL;
+		if((s = stream_delim(s, end, d, b, 0)) == NULL) {
+			*err = "unterminated 's' command";
+			return NULL;
+		}
+		c->text = malloc(b->len+1);
+		memcpy(c->text, b->b, b->len);
+		c->text_len = b->len;
+		for(; s < end && *s == 'g'; s++)
+			c->global = 1;
+	} break;
+	default:
+		*err = "unknown command";
+		return NULL;
+	}
+	while(s < end && (*s == ' ' || *s == '\t'))
+		s++;
+	if(s < end && *s != ';' && *s != '\n' && *s != '#') {
+		*err = "extra characters after command";
+		return NULL;
+	}
+	return s;
+}
+/* Compile script.
+ */
+stream *stream_compile(const char *script, size_t len, int flags,
+	const char **err)
+{
+	const char *s = script, *end = script+len;
+	struct sbuf b = { NULL, 0, 0 };
+	stream *st = calloc(1, sizeof(stream));
+	st->flags = flags;
+	while(s != NULL && s < end) {
+		if(*s == ' ' || *s == '\t' || *s == '\n' || *s == ';') {
+			s++;
+		} else if(*s == '#') {
+			while(s < end && *s != '\n')
+				s++;
+		} else {
+			s = stream_command(st, s, end, &b, err);
+		}
+	}
+	free(b.b);
+	if(s == NULL) {
+		stream_free(st);
+		return NULL;
+	}
+	st->in.cap = st->out.cap = STREAM_BUF;
+	st->in.b = malloc(STREAM_BUF);
+	st->out.b = malloc(STREAM_BUF);
+	st->app = malloc(sizeof(struct scmd *)*(st->n+1));
+	return st;
+}
+/* Free compiled pattern.
+ */
+static void stream_free_pattern(struct spat *p)
+{
+	if(p->re != NULL) dfa_free(p->re);
+	search_free(&p->f);
+}
+/* Free compiled script.
+ */
+void stream_free(stream *st)
+{
+	int i;
+	for(i = 0; i < st->n; i++) {
+		stream_free_pattern(&st->cmd[i].at);
+		stream_free_pattern(&st->cmd[i].pat);
+		free(st->cmd[i].text);
+	}
+	free(st->cmd);
+	free(st->in.b);
+	free(st->out.b);
+	free(st->line.b);
+	free(st->tmp.b);
+	free(st->m);
+	free(st->app);
+	free(st);
+}
+/* Read whole script file into buffer.
+ */
+static int stream_read_script(const char *path, struct sbuf *b)
+{
+	int fd = open(path, O_RDONLY);
+	ssize_t r;
+	if(fd < 0) return -1;
+	for(;;) {
+		sbuf_reserve(b, 4096);
+		r = read(fd, b->b+b->len, b->cap-b->len);
+		if(r < 0 && errno == EINTR) continue;
+		if(r <= 0) break;
+		b->len += r;
+	}
+	close(fd);
+	return r < 0 ? -1 : 0;
+}
+/* Print usage of stream mode.
+ */
+static int stream_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-n] [-i] [-w] [-E] -e script | "
+		"-f scriptfile [file...]\n", prog);
+	return 1;
+}
+/* Run prsed as a stream editor.
+ */
+int stream_main(int argc, char **argv)
+{
+	struct sbuf script = { NULL, 0, 0 };
+	const char *err = NULL;
+	int flags = 0, i, ret = 0, have = 0;
+	stream *st;
+	for(i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+		const char *a = argv[i];
+		if(strcmp(a, "--") == 0) {
+			i++;
+			break;
+		} else if(strcmp(a, "-e") == 0 && i+1 < argc) {
+			i++;
+			sbuf_add(&script, argv[i], strlen(argv[i]));
+			sbuf_add(&script, "\n", 1);
+			have = 1;
+		} else if(strcmp(a, "-f") == 0 && i+1 < argc) {
+			if(stream_read_script(argv[++i], &script) < 0) {
+				perror(argv[i]);
+				free(script.b);
+				return 1;
+			}
+			sbuf_add(&script, "\n", 1);
+			have = 1;
+		} else if(strcmp(a, "-n") == 0) {
+			flags |= STREAM_QUIET;
+		} else if(strcmp(a, "-i") == 0) {
+			flags |= SEARCH_ICASE;
+		} else if(strcmp(a, "-w") == 0) {
+			flags |= SEARCH_WORD;
+		} else if(strcmp(a, "-E") == 0) {
+			flags |= SEARCH_REGEX;
+		} else {
+			free(script.b);
+			return stream_usage(argv[0]);
+		}
+	}
+	if(!have) {
+		free(script.b);
+		return stream_usage(argv[0]);
+	}
+	st = stream_compile(script.b, script.len, flags, &err);
+	free(script.b);
+	if(st == NULL) {
+		fprintf(stderr, "%s: script: %s\n", argv[0], err);
+		return 1;
+	}
+	if(i == argc && stream_run(st, STDIN_FILENO, STDOUT_FILENO) < 0) {
+		perror(argv[0]);
+		ret = 1;
+	}
+	for(; i < argc; i++) {
+		int fd = strcmp(argv[i], "-") == 0 ? STDIN_FILENO :
+			open(argv[i], O_RDONLY);
+		if(fd < 0) {
+			perror(argv[i]);
+			ret = 1;
+			continue;
+		}
+		if(stream_run(st, fd, STDOUT_FILENO) < 0) {
+			perror(argv[i]);
+			ret = 1;
+		}
+		if(fd != STDIN_FILENO) close(fd);
+	}
+	if(stream_finish(st) < 0) {
+		perror(argv[0]);
+		ret = 1;
+	}
+	stream_free(st);
+	return ret;
+}
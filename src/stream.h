@@ -0,0 +1,38 @@
+/**
+ * @file stream.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Non-interactive stream editing of text with a small script.
+ ********************************************************************
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+
+/* Bytes read ahead and written behind */
+#define STREAM_BUF (1024*1024)
+/* Script options past the search options of search.h */
+#define STREAM_QUIET (1<<8)	/* only print what 'p' prints */
+
+/* Compiled stream script */
+typedef struct stream stream;
+
+/* Compile script with search options, returns NULL with a message in
+ * 'err' when the script is broken. */
+stream *stream_compile(const char *script, size_t len, int flags,
+	const char **err);
+/* Run script over input 'in' writing to 'out', the inputs of a stream
+ * follow each other as one text. Returns -1 with errno set on a read or
+ * write error. */
+int stream_run(stream *st, int in, int out);
+/* End the stream, running the last line when the script addresses it
+ * with '$'. Returns -1 with errno set on a write error. */
+int stream_finish(stream *st);
+/* Free compiled script. */
+void stream_free(stream *st);
+/* Run prsed as a stream editor with command line arguments. */
+int stream_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,338 @@
+/**
+ * @file syntax.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Filetype database and table driven syntax lexer for PRS Edit.
+ *
+ * Every language is described by a plain definition below. The first
+ * time a language is used it is compiled into a 256 entry character
+ * class table and an open addressing hash set of its keywords, so the
+ * lexer only does table lookups per character. Languages are picked by
+ * file extension or name, or by the interpreter named on a "#!" line.
+ ************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "syntax.h"
+
+/* Character classes */
+#define CC_SEP 1
+#define CC_IDENT 2
+#define CC_DIGIT 4
+#define CC_POINT 8
+#define CC_QUOTE 16
+#define CC_COMMENT 32
+/* Longest word looked up in the keyword set */
+#define SYNTAX_WORD_MAX 32
+
+/* C and C++ */
+static const char *const c_match[] = {
+	".c", ".h", ".cc", ".cpp", ".cxx", ".hpp", NULL
+};
+static const char *const c_keywords[] = {
+	"switch", "if", "while", "for", "break", "continue", "return", "else",
+	"struct", "union", "typedef", "static", "enum", "class", "case",
+	"default", "do", "goto", "sizeof", "extern", "const", "volatile",
+	"register", "inline", "#include", "#define",
+	"int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
+	"void|", "short|", "size_t|", NULL
+};
+/* Python */
+static const char *const py_match[] = { ".py", NULL };
+static const char *const py_shebang[] = { "python", NULL };
+static const char *const py_keywords[] = {
+	"and", "as", "assert", "break", "class", "continue", "def", "del",
+	"elif", "else", "except", "finally", "for", "from", "global", "if",
+	"import", "in", "is", "lambda", "nonlocal", "not", "or", "pass",
+	"raise", "return", "try", "while", "with", "yield",
+	"True|", "False|", "None|", "self|", NULL
+};
+/* Shell */
+static const char *const sh_match[] = { ".sh", ".bash", NULL };
+static const char *const sh_shebang[] = { "sh", "bash", "dash", "zsh", NULL };
+static const char *const sh_keywords[] = {
+	"if", "then", "else", "elif", "fi", "for", "while", "until", "do",
+	"done", "case", "esac", "function", "in", "return", "local",
+	"export", "echo|", "cd|", "exit|", "set|", "shift|", NULL
+};
+/* Makefile */
+static const char *const mk_match[] = {
+	"Makefile", "makefile", "GNUmakefile", ".mk", NULL
+};
+static const char *const mk_keywords[] = {
+	"ifeq", "ifneq", "ifdef", "ifndef", "else", "endif", "include",
+	"define", "endef", "export", NULL
+};
+
+/* Filetype database, plain text last */
+static const struct syntax_def syntax_db[] = {
+	{ "c", c_match, NULL, c_keywords, "//", "/*", "*/", "\"'",
+		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS },
+	{ "python", py_match, py_shebang, py_keywords, "#", NULL, NULL, "\"'",
+		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS },
+	{ "sh", sh_match, sh_shebang, sh_keywords, "#", NULL, NULL, "\"'",
+		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS },
+	{ "make", mk_match, NULL, mk_keywords, "#", NULL, NULL, NULL, 0 },
+	{ "text", NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+		HL_HIGHLIGHT_NUMBERS }
+};
+#define SYNTAX_DB_SIZE (sizeof(syntax_db)/sizeof(syntax_db[0]))
+
+/* Compiled languages, filled in on first use */
+static syntax *syntax_tab[SYNTAX_DB_SIZE];
+
+/* Hash word for keyword set (FNV-1a).
+ */
+static unsigned int syntax_hash(const char *s, int len)
+{
+	unsigned int h = 2166136261u;
+	int i;
+	for(i = 0; i < len; i++)
+		h = (h ^ (unsigned char)s[i])*16777619u;
+	return h;
+}
+/* Compile language definition into lookup tables.
+ */
+static syntax *syntax_compile(const struct syntax_def *def)
+{
+	static const char seps[] = ",.()+-/*=~%<>[]{};:!&|^?";
+	syntax *syn = calloc(1, sizeof(syntax));
+	const char *p;
+	int c, n = 0;
+	syn->def = def;
+	for(c = 0; c < 256; c++) {
+		if(isspace(c) || c == '\0' || (c != 0 && strchr(seps, c) != NULL))
+			syn->cls[c] |= CC_SEP;
+		if(isalnum(c) || c == '_')
+			syn->cls[c] |= CC_IDENT;
+		if(isdigit(c) && (def->flags & HL_HIGHLIGHT_NUMBERS))
+			syn->cls[c] |= CC_DIGIT;
+	}
+	if(def->flags & HL_HIGHLIGHT_NUMBERS)
+		syn->cls['.'] |= CC_POINT;
+	if(def->quotes != NULL && (def->flags & HL_HIGHLIGHT_STRINGS))
+		for(p = def->quotes; *p != '\0'; p++)
+			syn->cls[(unsigned char)*p] |= CC_QUOTE;
+	if(def->comment != NULL)
+		syn->cls[(unsigned char)def->comment[0]] |= CC_COMMENT;
+	if(def->ml_start != NULL)
+		syn->cls[(unsigned char)def->ml_start[0]] |= CC_COMMENT;
+	/* keywords such as "#include" start with a character of their own */
+	if(def->keywords != NULL) {
+		unsigned int size = 16;
+		for(n = 0; def->keywords[n] != NULL; n++)
+			syn->cls[(unsigned char)def->keywords[n][0]] |= CC_IDENT;
+		while(size < (unsigned int)n*2) size *= 2;
+		syn->kw = calloc(size, sizeof(struct syntax_kw));
+		syn->kw_mask = size-1;
+		for(n = 0; def->keywords[n] != NULL; n++) {
+			const char *kw = def->keywords[n];
+			int len = strlen(kw), hl = HL_KEYWORD1;
+			unsigned int h;
+			if(kw[len-1] == '|') {
+				len--;
+				hl = HL_KEYWORD2;
+			}
+			h = syntax_hash(kw, len) & syn->kw_mask;
+			while(syn->kw[h].s != NULL) h = (h+1) & syn->kw_mask;
+			syn->kw[h].s = kw;
+			syn->kw[h].len = len;
+			syn->kw[h].hl = hl;
+		}
+	}
+	syn->multiline = (def->ml_start != NULL) ||
+		(syn->cls['"'] & CC_QUOTE) || (syn->cls['\''] & CC_QUOTE);
+	return syn;
+}
+/* Get compiled language from database entry.
+ */
+static const syntax *syntax_get(int i)
+{
+	if(syntax_tab[i] == NULL)
+		syntax_tab[i] = syntax_compile(&syntax_db[i]);
+	return syntax_tab[i];
+}
+/* Look word up in keyword set, return its highlight or zero.
+ */
+static int syntax_keyword(const syntax *syn, const char *w, int len)
+{
+	unsigned int h;
+	if(syn->kw == NULL) return 0;
+	h = syntax_hash(w, len) & syn->kw_mask;
+	while(syn->kw[h].s != NULL) {
+		if(syn->kw[h].len == len && memcmp(syn->kw[h].s, w, len) == 0)
+			return syn->kw[h].hl;
+		h = (h+1) & syn->kw_mask;
+	}
+	return 0;
+}
+/* Check if interpreter 'name' is 'entry' with an optional version.
+ */
+static int syntax_interp(const char *name, int len, const char *entry)
+{
+	int n = strlen(entry);
+	if(len < n || memcmp(name, entry, n) != 0) return 0;
+	while(n < len && (isdigit((unsigned char)name[n]) || name[n] == '.'))
+		n++;
+	return n == len;
+}
+/* Find language for file.
+ */
+const syntax *syntax_find(const char *filename, const char *line, int len)
+{
+	const char *base = NULL, *ext = NULL;
+	int i, j;
+	if(filename != NULL) {
+		base = strrchr(filename, '/');
+		base = (base != NULL) ? base+1 : filename;
+		ext = strrchr(base, '.');
+	}
+	for(i = 0; base != NULL && i < (int)SYNTAX_DB_SIZE; i++) {
+		const char *const *m = syntax_db[i].match;
+		for(j = 0; m != NULL && m[j] != NULL; j++) {
+			if(m[j][0] == '.' ? (ext != NULL && strcmp(ext, m[j]) == 0) :
+			    strcmp(base, m[j]) == 0)
+				return syntax_get(i);
+		}
+	}
+	if(line != NULL && len > 2 && line[0] == '#' && line[1] == '!') {
+		/* interpreter is the last path part, "env" names it next */
+		const char *p = line+2, *end = line+len, *name = NULL;
+		int n = 0;
+		while(p < end) {
+			const char *q;
+			while(p < end && isspace((unsigned char)*p)) p++;
+			for(q = p; q < end && !isspace((unsigned char)*q); q++)
+				if(*q == '/') p = q+1;
+			name = p;
+			n = q-p;
+			if(n != 3 || memcmp(name, "env", 3) != 0) break;
+			p = q;
+		}
+		for(i = 0; name != NULL && i < (int)SYNTAX_DB_SIZE; i++) {
+			const char *const *s = syntax_db[i].shebang;
+			for(j = 0; s != NULL && s[j] != NULL; j++)
+				if(syntax_interp(name, n, s[j]))
+					return syntax_get(i);
+		}
+	}
+	return syntax_get(SYNTAX_DB_SIZE-1);
+}
+/* Match 'str' at logical position 'i' of text.
+ */
+static int syntax_match(const char *c, int size, int gap, int skip, int i,
+	const char *str)
+{
+	int k;
+	for(k = 0; str[k] != '\0'; k++, i++) {
+		if(i >= size) return 0;
+		if(c[i < gap ? i : i+skip] != str[k]) return 0;
+	}
+	return k;
+}
+/* Lex text of one row.
+ */
+int syntax_lex(const syntax *syn, const char *c, unsigned char *hl,
+	int size, int gap, int skip, int state)
+{
+#define LEX_AT(i) ((i) < gap ? (i) : (i)+skip)
+#define LEX_SET(i, h) do { if(hl != NULL) hl[LEX_AT(i)] = (h); } while(0)
+	const struct syntax_def *def = syn->def;
+	const unsigned char *cls = syn->cls;
+	int i = 0, prev_hl = HL_NORMAL, prev_sep = 1, cont = 0;
+	while(i < size) {
+		int ch = (unsigned char)c[LEX_AT(i)];
+		int k = cls[ch], n, h;
+		if(state == SYNTAX_COMMENT) {
+			n = syntax_match(c, size, gap, skip, i, def->ml_end);
+			if(n > 0) state = SYNTAX_NORMAL;
+			else n = 1;
+			for(; n > 0; n--, i++) LEX_SET(i, HL_MLCOMMENT);
+			prev_hl = HL_MLCOMMENT;
+			prev_sep = 1;
+			continue;
+		}
+		if(state != SYNTAX_NORMAL) {
+			/* inside string, state is the quote that closes it */
+			LEX_SET(i, HL_STRING);
+			if(ch == '\\' && i+1 < size) {
+				i++;
+				LEX_SET(i, HL_STRING);
+			} else if(ch == '\\') {
+				cont = 1;
+			} else if(ch == state) {
+				state = SYNTAX_NORMAL;
+			}
+			prev_hl = HL_STRING;
+			prev_sep = 1;
+			i++;
+			continue;
+		}
+		if(k & CC_COMMENT) {
+			if(def->comment != NULL &&
+			    syntax_match(c, size, gap, skip, i, def->comment)) {
+				for(; i < size; i++) LEX_SET(i, HL_COMMENT);
+				break;
+			}
+			if(def->ml_start != NULL &&
+			    (n = syntax_match(c, size, gap, skip, i, def->ml_start))) {
+				for(; n > 0; n--, i++) LEX_SET(i, HL_MLCOMMENT);
+				state = SYNTAX_COMMENT;
+				continue;
+			}
+		}
+		if(k & CC_QUOTE) {
+			LEX_SET(i, HL_STRING);
+			state = ch;
+			prev_hl = HL_STRING;
+			i++;
+			continue;
+		}
+		if((k & CC_IDENT) && !(k & CC_DIGIT) && prev_sep) {
+			/* whole word at once, either a keyword or plain text */
+			char w[SYNTAX_WORD_MAX];
+			int end = i;
+			h = HL_NORMAL;
+			do {
+				if(end-i < SYNTAX_WORD_MAX) w[end-i] = c[LEX_AT(end)];
+				end++;
+			} while(end < size && (cls[(unsigned char)c[LEX_AT(end)]] &
+			    CC_IDENT));
+			if(end-i < SYNTAX_WORD_MAX && (end == size ||
+			    (cls[(unsigned char)c[LEX_AT(end)]] & CC_SEP)))
+				h = syntax_keyword(syn, w, end-i);
+			for(; i < end; i++) LEX_SET(i, h);
+			prev_sep = (cls[(unsigned char)c[LEX_AT(end-1)]] & CC_SEP);
+			prev_hl = h;
+			continue;
+		}
+		h = (((k & CC_DIGIT) && (prev_sep || prev_hl == HL_NUMBER)) ||
+			((k & CC_POINT) && prev_hl == HL_NUMBER)) ?
+			HL_NUMBER : HL_NORMAL;
+		LEX_SET(i, h);
+		prev_sep = (h != HL_NUMBER) && (k & CC_SEP);
+		prev_hl = h;
+		i++;
+	}
+	/* strings only go on past the end of a row after a backslash */
+	if(state != SYNTAX_NORMAL && state != SYNTAX_COMMENT && !cont)
+		state = SYNTAX_NORMAL;
+	return state;
+#undef LEX_SET
+#undef LEX_AT
+}
+/* Release compiled languages.
+ */
+void syntax_free(void)
+{
+	size_t i;
+	for(i = 0; i < SYNTAX_DB_SIZE; i++) {
+		if(syntax_tab[i] == NULL) continue;
+		free(syntax_tab[i]->kw);
+		free(syntax_tab[i]);
+		syntax_tab[i] = NULL;
+	}
+}
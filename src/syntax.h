@@ -0,0 +1,70 @@
+/**
+ * @file syntax.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Filetype database and table driven syntax lexer.
+ ********************************************************************
+ */
+
+#ifndef SYNTAX_H
+#define SYNTAX_H
+
+/* Highlight classes */
+enum syntax_highlight {
+	HL_NORMAL = 0,
+	HL_COMMENT,
+	HL_MLCOMMENT,
+	HL_KEYWORD1,
+	HL_KEYWORD2,
+	HL_STRING,
+	HL_NUMBER,
+	HL_MATCH,
+	HL_MAX
+};
+/* Lexer state at the end of a row, a string state is its quote */
+enum syntax_state {
+	SYNTAX_NORMAL = 0,
+	SYNTAX_COMMENT
+};
+
+/* Language highlighting flags */
+#define HL_HIGHLIGHT_NUMBERS (1<<0)
+#define HL_HIGHLIGHT_STRINGS (1<<1)
+
+/* Language definition, keywords ending in '|' are highlighted as types */
+struct syntax_def {
+	const char *name;
+	const char *const *match;
+	const char *const *shebang;
+	const char *const *keywords;
+	const char *comment;
+	const char *ml_start;
+	const char *ml_end;
+	const char *quotes;
+	int flags;
+};
+/* Keyword hash set entry */
+struct syntax_kw {
+	const char *s;
+	int len;
+	int hl;
+};
+/* Language compiled into lookup tables */
+typedef struct syntax {
+	const struct syntax_def *def;
+	unsigned char cls[256];
+	struct syntax_kw *kw;
+	unsigned int kw_mask;
+	int multiline;
+} syntax;
+
+/* Find language for file name or first line ("#!"), plain text if none. */
+const syntax *syntax_find(const char *filename, const char *line, int len);
+/* Lex text from 'state', position 'i' is stored at 'i' before 'gap' and
+ * at 'i+skip' after it; fills 'hl' unless NULL, returns the end state. */
+int syntax_lex(const syntax *syn, const char *c, unsigned char *hl,
+	int size, int gap, int skip, int state);
+/* Release compiled languages. */
+void syntax_free(void);
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file undo.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Undo journal of compact edit deltas for PRS Edit.
+ *
+ * Every edit is one small record (operation, row, column) plus the bytes
+ * it put in or took out, appended to a byte arena. Taking an edit back
+ * or doing it again only walks a cursor over the records, so each costs
+ * the size of that edit whatever the size of the file. Records carry the
+ * step (key press) they belong to and a step is undone as a whole.
+ * When history outgrows its limit whole steps are dropped from the
+ * front, the arrays are only compacted once half of them is dead.
+ ************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "undo.h"
+
+/* Initialise empty journal.
+ */
+void undo_init(undo *u, size_t max)
+{
+	memset(u, 0, sizeof(undo));
+	u->max = max;
+	u->fresh = 1;
+}
+/* Free every record of journal.
+ */
+void undo_free(undo *u)
+{
+	size_t max = u->max;
+	free(u->rec);
+	free(u->bytes);
+	undo_init(u, max);
+}
+/* Start a new step.
+ */
+void undo_step(undo *u)
+{
+	u->fresh = 1;
+}
+/* Forget records that were taken back.
+ */
+static void undo_truncate(undo *u)
+{
+	while(u->n > u->cur) {
+		u->n--;
+		u->used -= sizeof(undo_rec)+u->rec[u->n].len;
+		u->blen = u->rec[u->n].off;
+	}
+}
+/* Move live records and bytes to the front of their arrays.
+ */
+static void undo_compact(undo *u)
+{
+	size_t i;
+	if(u->base == u->n) {
+		u->base = u->cur = u->n = 0;
+		u->bbase = u->blen = 0;
+		return;
+	}
+	memmove(u->rec, &u->rec[u->base], sizeof(undo_rec)*(u->n-u->base));
+	memmove(u->bytes, &u->bytes[u->bbase], u->blen-u->bbase);
+	u->n -= u->base;
+	u->cur -= u->base;
+	for(i = 0; i < u->n; i++)
+		u->rec[i].off -= u->bbase;
+	u->blen -= u->bbase;
+	u->base = 0;
+	u->bbase = 0;
+}
+/* Drop the oldest steps until history fits its limit again.
+ */
+static void undo_trim(undo *u)
+{
+	if(u->used <= u->max) return;
+	while(u->used > u->max && u->base < u->n) {
+		unsigned int step = u->rec[u->base].step;
+		/* the step being recorded is gone, so is the rest of it */
+		if(step == u->step) u->lost = 1;
+		while(u->base < u->n && u->rec[u->base].step == step) {
+			undo_rec *r = &u->rec[u->base++];
+			u->used -= sizeof(undo_rec)+r->len;
+			u->bbase = r->off+r->len;
+		}
+	}
+	if(u->base >= u->n-u->base || u->bbase >= u->blen-u->bbase)
+		undo_compact(u);
+}
+/* Make room for 'len' more bytes in the arena.
+ */
+static void undo_reserve(undo *u, size_t len)
+{
+	if(u->bcap-u->blen < len) {
+		size_t cap = u->bcap*2;
+		if(cap < u->blen+len) cap = u->blen+len+256;
+		u->bytes = realloc(u->bytes, cap);
+		u->bcap = cap;
+	}
+}
+/* Append record to the journal.
+ */
+void undo_record(undo *u, int op, int row, int col, const char *s,
+	size_t len)
+{
+	undo_rec *r;
+	undo_truncate(u);
+	if(u->fresh) {
+		u->step++;
+		u->fresh = 0;
+		u->lost = 0;
+	}
+	if(u->lost) return;
+	if(u->n == u->cap) {
+		u->cap = u->cap > 0 ? u->cap*2 : 64;
+		u->rec = realloc(u->rec, sizeof(undo_rec)*u->cap);
+	}
+	undo_reserve(u, len);
+	r = &u->rec[u->n++];
+	r->op = op;
+	r->row = row;
+	r->col = col;
+	r->off = u->blen;
+	r->len = len;
+	r->step = u->step;
+	if(len > 0) memcpy(&u->bytes[u->blen], s, len);
+	u->blen += len;
+	u->cur = u->n;
+	u->used += sizeof(undo_rec)+len;
+	undo_trim(u);
+}
+/* Record typed text, merged into the last record when it carries on.
+ */
+void undo_typed(undo *u, int row, int col, const char *s, size_t len)
+{
+	undo_rec *r = u->n > u->base ? &u->rec[u->n-1] : NULL;
+	if(r != NULL && u->cur == u->n && r->op == UNDO_INSERT &&
+	    r->row == row && r->col+r->len == (size_t)col &&
+	    r->off+r->len == u->blen) {
+		undo_reserve(u, len);
+		memcpy(&u->bytes[u->blen], s, len);
+		u->blen += len;
+		r->len += len;
+		u->used += len;
+		/* anything else done by this key press joins the typed run */
+		u->fresh = 0;
+		undo_trim(u);
+		return;
+	}
+	undo_record(u, UNDO_INSERT, row, col, s, len);
+}
+/* Take back the last applied record.
+ */
+const undo_rec *undo_back(undo *u, int more)
+{
+	if(u->cur == u->base) return NULL;
+	if(more && u->cur < u->n &&
+	    u->rec[u->cur-1].step != u->rec[u->cur].step)
+		return NULL;
+	u->fresh = 1;
+	return &u->rec[--u->cur];
+}
+/* Redo the next record taken back.
+ */
+const undo_rec *undo_forward(undo *u, int more)
+{
+	if(u->cur == u->n) return NULL;
+	if(more && u->cur > u->base &&
+	    u->rec[u->cur-1].step != u->rec[u->cur].step)
+		return NULL;
+	u->fresh = 1;
+	return &u->rec[u->cur++];
+}
+/* Bytes of record.
+ */
+const char *undo_bytes(const undo *u, const undo_rec *r)
+{
+	return &u->bytes[r->off];
+}
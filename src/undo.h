@@ -0,0 +1,65 @@
+/**
+ * @file undo.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Undo journal of compact edit deltas.
+ ********************************************************************
+ */
+
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <stddef.h>
+
+/* Edit operations kept by the journal */
+enum undo_op {
+	UNDO_INSERT = 0,	/* text put into row at column */
+	UNDO_DELETE,		/* text taken out of row at column */
+	UNDO_SPLIT,		/* row broken in two at column */
+	UNDO_JOIN,		/* next row appended to row at column */
+	UNDO_ROW_INSERT,	/* whole row added */
+	UNDO_ROW_DELETE,	/* whole row removed */
+	UNDO_ROWS_INSERT,	/* 'col' rows added, each ends with '\n' */
+	UNDO_ROWS_DELETE	/* 'col' rows removed, each ends with '\n' */
+};
+/* One journal record, its bytes live in the journal arena */
+typedef struct undo_rec {
+	int op;
+	int row, col;
+	size_t off, len;
+	unsigned int step;
+} undo_rec;
+/* Undo journal, records 'base' to 'cur' are applied, 'cur' to 'n' were
+ * taken back and can be redone */
+typedef struct undo {
+	undo_rec *rec;
+	size_t base, cur, n, cap;
+	char *bytes;
+	size_t bbase, blen, bcap;
+	size_t used, max;
+	unsigned int step;
+	int fresh;
+	int lost;
+} undo;
+
+/* Initialise empty journal keeping about 'max' bytes of history. */
+void undo_init(undo *u, size_t max);
+/* Free every record of journal. */
+void undo_free(undo *u);
+/* Start a new step, records up to the next call are taken back together. */
+void undo_step(undo *u);
+/* Append record to the journal, dropping anything that was taken back. */
+void undo_record(undo *u, int op, int row, int col, const char *s,
+	size_t len);
+/* Record typed text, merged into the last record when it carries on. */
+void undo_typed(undo *u, int row, int col, const char *s, size_t len);
+/* Take back the last applied record, NULL when none is left or when 'more'
+ * is set and the record belongs to an earlier step. */
+const undo_rec *undo_back(undo *u, int more);
+/* Redo the next record taken back, NULL when none is left or when 'more'
+ * is set and the record belongs to a later step. */
+const undo_rec *undo_forward(undo *u, int more);
+/* Bytes of record. */
+const char *undo_bytes(const undo *u, const undo_rec *r);
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file worker.c
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Background worker thread for PRS Edit.
+ *
+ * The editor state is guarded by one lock which the foreground thread
+ * holds all the time except while it waits for input. The worker runs
+ * its job function with the lock held, the job function drops the lock
+ * itself around the slow part of a job. Without threads the lock calls
+ * still work and the job function is simply never called.
+ ************************************************************************
+ */
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "worker.h"
+
+/* Editor state lock and worker signals */
+static pthread_mutex_t wk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wk_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t wk_idle = PTHREAD_COND_INITIALIZER;
+/* Worker state */
+static struct {
+	pthread_t thread;
+	int (*fn)(void *);
+	void *arg;
+	int started;
+	int pending;
+	int busy;
+	int hold;
+} wk;
+
+/* Worker thread loop.
+ */
+static void *worker_main(void *arg)
+{
+	pthread_mutex_lock(&wk_lock);
+	for(;;) {
+		int more;
+		if(wk.hold || !wk.pending) {
+			pthread_cond_wait(&wk_work, &wk_lock);
+			continue;
+		}
+		wk.busy = 1;
+		more = wk.fn(wk.arg);
+		wk.busy = 0;
+		pthread_cond_broadcast(&wk_idle);
+		if(!more) {
+			wk.pending = 0;
+			continue;
+		}
+		/* let the foreground in between jobs */
+		pthread_mutex_unlock(&wk_lock);
+		sched_yield();
+		pthread_mutex_lock(&wk_lock);
+	}
+	return arg;
+}
+/* Start worker thread.
+ */
+int worker_start(int (*fn)(void *), void *arg)
+{
+	if(wk.started) return 0;
+	pthread_mutex_lock(&wk_lock);
+	wk.fn = fn;
+	wk.arg = arg;
+	wk.started = 1;
+	if(pthread_create(&wk.thread, NULL, worker_main, NULL) != 0)
+		return -1;
+	pthread_detach(wk.thread);
+	return 0;
+}
+/* Take state lock.
+ */
+void worker_lock(void)
+{
+	pthread_mutex_lock(&wk_lock);
+}
+/* Give state lock back.
+ */
+void worker_unlock(void)
+{
+	pthread_mutex_unlock(&wk_lock);
+}
+/* Wake worker for new work.
+ */
+void worker_kick(void)
+{
+	wk.pending = 1;
+	pthread_cond_signal(&wk_work);
+}
+/* Keep worker out of jobs.
+ */
+void worker_hold(void)
+{
+	wk.hold = 1;
+	while(wk.busy)
+		pthread_cond_wait(&wk_idle, &wk_lock);
+}
+/* Let worker take jobs again.
+ */
+void worker_release(void)
+{
+	wk.hold = 0;
+	pthread_cond_signal(&wk_work);
+}
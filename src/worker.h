@@ -0,0 +1,26 @@
+/**
+ * @file worker.h
+ * @author Philip R. Simonson
+ * @date 10/16/2026
+ * @brief Background worker thread sharing the editor state lock.
+ ********************************************************************
+ */
+
+#ifndef WORKER_H
+#define WORKER_H
+
+/* Start worker calling 'fn' (with the lock held) while it returns
+ * nonzero, the calling thread owns the lock from here on. */
+int worker_start(int (*fn)(void *), void *arg);
+/* Take the editor state lock. */
+void worker_lock(void);
+/* Give the editor state lock back. */
+void worker_unlock(void);
+/* Tell worker there may be new work (lock held). */
+void worker_kick(void);
+/* Wait until worker is between jobs and keep it there (lock held). */
+void worker_hold(void);
+/* Let worker pick up jobs again (lock held). */
+void worker_release(void);
+
+#endif